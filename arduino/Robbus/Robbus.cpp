@@ -4,6 +4,7 @@
 	Released into the public domain.
 */
 #include <stdlib.h>
+#include <string.h>
 
 #include "WProgram.h"
 #include "Robbus.h"
@@ -18,6 +19,11 @@
 #define SUBPACKET_ECHO 'e'
 #define SUBPACKET_DESCRIPTION 'd'
 #define SUBPACKET_CHANGE_ADDRESS 'a'
+#define SUBPACKET_CHANGED 'c'
+#define SUBPACKET_BULK_BEGIN 'B'
+#define SUBPACKET_BULK_WRITE 'W'
+#define SUBPACKET_BULK_ACK 'K'
+#define SUBPACKET_BULK_READ 'R'
 
 // shadowing the memory space
 #define receivedAddress usartBufferIndex
@@ -35,9 +41,58 @@ enum RxStateEnum  {
 	RX_STATE_WAIT_FOR_ADDRESS = 0x03,
 	RX_STATE_WAIT_FOR_LENGTH = 0x04,
 	RX_STATE_WAIT_FOR_DATA = 0x05,
-	RX_STATE_WAIT_FOR_CHECKSUM = 0x06
+	RX_STATE_WAIT_FOR_CHECKSUM = 0x06,
+
+	// multi node packet, details in multiState
+	RX_STATE_MULTI = 0x07
+};
+
+// multi node packet states - bits 2:0 of multiState
+// regular head, address MULTI_PACKET_ADDRESS, body length, sections
+// (address, length, payload) and checksum of everything after the head
+enum MultiStateEnum {
+	MULTI_STATE_LENGTH = 0x00,
+	MULTI_STATE_SECTION_ADDRESS = 0x01,
+	MULTI_STATE_SECTION_LENGTH = 0x02,
+	MULTI_STATE_SECTION_DATA = 0x03,
+	MULTI_STATE_CHECKSUM = 0x04
 };
 
+// multi node packet flags - bits 7:6 of multiState
+#define MULTI_FLAG_OWN_SECTION          0x80    //! current section is for this node
+#define MULTI_FLAG_RECEIVED             0x40    //! own section complete
+
+#define MULTI_STATE_MASK 0x07
+
+// reply address of nonexistent node 0, ignored by nodes not knowing multi packets
+#define MULTI_PACKET_ADDRESS 0x80
+
+// group read packet: group head, address with this bit set, mask, length,
+// slot width and regular payload. Every matching node replies in its slot,
+// the slot index is the part of the address not covered by the mask.
+#define GROUP_READ_FLAG 0x80
+
+// slot width unit in microseconds
+#define GROUP_READ_SLOT_UNIT_US 10
+
+// change only service subpacket: 'c', input sequence, output sequence known
+// to the host and the input if it changed (the last one is used otherwise).
+// Reply is output sequence followed by the output if the host does not have
+// it yet, empty reply asks for the input again. Sequence 0 means none.
+#define CHANGED_HEADER_SIZE 3
+
+// bulk transfer into the buffer given by setBulkBuffer(), 16 bit values little endian:
+// 'B', total length, block size - starts transfer, reply is block size accepted
+//      (0 if refused) and buffer capacity
+// 'W', block index, data - block of the transfer, no reply
+// 'K' - reply is index of the first missing block and bitmap of received blocks from it
+// 'R', offset, length - reply is buffer content
+#define BULK_HEADER_SIZE 3
+// blocks the host may send before asking for acknowledgement
+#define BULK_WINDOW 8
+// longest block, the receive buffer grows to it when bulk buffer is set
+#define ROBBUS_BULK_BLOCK_SIZE 32
+
 // TX states - bits 4:3
 enum TxStateEnum  {
 	TX_STATE_READY = 0x00,
@@ -94,14 +149,23 @@ void RobbusLib::begin(RobbusCommWrapper* commWrapperPtr, byte address, byte inDa
 	outgoingDataSize = outDataSize;	
 
 	// TODO this is nasty but I haven't found a better way
-	inDataSize = inDataSize > ROBBUS_MIN_BUFFER_SIZE ? inDataSize : ROBBUS_MIN_BUFFER_SIZE;	
-	usartBufferSize = inDataSize > outDataSize ? inDataSize:outDataSize; 
+	// space for the slot width of group read and sequences of change only packets
+	inDataSize = inDataSize + CHANGED_HEADER_SIZE > ROBBUS_MIN_BUFFER_SIZE ? inDataSize + CHANGED_HEADER_SIZE : ROBBUS_MIN_BUFFER_SIZE;	
+	usartBufferSize = inDataSize > outDataSize + 1 ? inDataSize:outDataSize + 1; 
 	usartBuffer = (byte*) malloc(usartBufferSize * sizeof(byte)); 
+	lastInput = (byte*) calloc(incomingDataSize + 1, sizeof(byte));
+	lastOutput = (byte*) calloc(outgoingDataSize + 1, sizeof(byte));
+	inputSequence = 0;
+	outputSequence = 1;
 
 	commWrapper->begin();
 
 	// initialize state machine
 	robbusState = 0;
+	replyPending = 0;
+	bulkBuffer = NULL;
+	bulkCapacity = 0;
+	bulkBlockSize = 0;
 
 	// initialize buffer indices
 	usartBufferIndex = 0;
@@ -109,6 +173,12 @@ void RobbusLib::begin(RobbusCommWrapper* commWrapperPtr, byte address, byte inDa
 
 void RobbusLib::process()
 {
+	// slot of this node reached, send the group read reply
+	if (replyPending && micros() - slotStart >= slotDelay) {
+		replyPending = 0;
+		startReply(REGULAR_PACKET_HEAD);
+	}
+
 	if (!commWrapper->available()) {
 		// nothing to receive...
 		// if we have something to send, do it now
@@ -174,20 +244,19 @@ void RobbusLib::process()
 	switch (getRxState()) {
 		// group sequence       
 		case RX_STATE_WAIT_FOR_GROUP_ADDRESS:
-			if (data & ADDRESS_REPLY_MASK) {
-				changeRxState(RX_STATE_READY); // reply from someone (even me ;), ignore rest of packet
-			} else {
-				receivedAddress = data;
-				checkSumInit();
-				checkSumAdd(data);
-				changeRxState(RX_STATE_WAIT_FOR_GROUP_MASK);
-			}
+			groupRead = data & GROUP_READ_FLAG;
+			receivedAddress = data & ~GROUP_READ_FLAG;
+			checkSumInit();
+			checkSumAdd(data);
+			changeRxState(RX_STATE_WAIT_FOR_GROUP_MASK);
 			break;
 	
 		case RX_STATE_WAIT_FOR_GROUP_MASK:
 			if ((data & receivedAddress) != (data & deviceAddress)) {
 				changeRxState(RX_STATE_READY); // reply from someone, ignore rest of packet
 			} else {
+				if (groupRead)
+					groupRead |= deviceAddress & ~data & ~GROUP_READ_FLAG;
 				receivedAddress = data;
 				checkSumAdd(data);
 				changeRxState(RX_STATE_WAIT_FOR_LENGTH);
@@ -196,7 +265,12 @@ void RobbusLib::process()
 
 		// regulsr sequence     
 		case RX_STATE_WAIT_FOR_ADDRESS:
-			if (data & ADDRESS_REPLY_MASK || data != deviceAddress) {
+			if (data == MULTI_PACKET_ADDRESS && !getFlag(RX_FLAG_SERVICE_PACKET|RX_FLAG_GROUP_PACKET)) {
+				checkSumInit();
+				checkSumAdd(data);
+				multiState = MULTI_STATE_LENGTH;
+				changeRxState(RX_STATE_MULTI);
+			} else if (data & ADDRESS_REPLY_MASK || data != deviceAddress) {
 				changeRxState(RX_STATE_READY); // reply from someone, or for another one ignore rest of packet
 			} else {
 				checkSumInit();
@@ -235,9 +309,20 @@ void RobbusLib::process()
 						return;
 					}
 				} else {
-					byte i;
+					byte i, *inData = usartBuffer;
+					if (getFlag(RX_FLAG_GROUP_PACKET) && groupRead) {
+						// the first byte is slot width, slots count from the end of the request
+						if (payloadLength == 0) {
+							changeRxState(RX_STATE_READY);
+							return;
+						}
+						slotStart = micros();
+						slotDelay = (unsigned long)(groupRead & ~GROUP_READ_FLAG) * usartBuffer[0] * GROUP_READ_SLOT_UNIT_US;
+						replyPending = 1;
+						inData++;
+					}
 					// process regular packet
-					byte* replyData = commandHandler(usartBuffer);
+					byte* replyData = commandHandler(inData);
 					
 					// copy user data to uart buffer
 					for (i = 0; i < outgoingDataSize; i++)
@@ -248,20 +333,14 @@ void RobbusLib::process()
 				
 				// if not group packet, send reply
 				if (!(getFlag(RX_FLAG_GROUP_PACKET)))
-				{
-					// initialize checksum
-					checkSumInit();
-					
-					// set tx machine state
-					changeTxState(TX_STATE_SEND_ADDRESS);
-					clearFlag(RX_FLAG_SPECIAL_CHAR);
-					
-					// and push first byte into usart register
-					commWrapper->write(getFlag((RX_FLAG_SERVICE_PACKET) ? SERVICE_PACKET_HEAD : REGULAR_PACKET_HEAD));
-				}
+					startReply(getFlag(RX_FLAG_SERVICE_PACKET) ? SERVICE_PACKET_HEAD : REGULAR_PACKET_HEAD);
 			}
 			changeRxState(RX_STATE_READY);
 			break;
+
+		case RX_STATE_MULTI:
+			doMultiPacket(data);
+			break;
 	
 		default:
 			// should never happen ;-)
@@ -270,6 +349,29 @@ void RobbusLib::process()
 	}
 }
 
+// call after begin(), enlarges the receive buffer to take whole blocks
+void RobbusLib::setBulkBuffer(byte* buffer, unsigned int size)
+{
+	if (buffer != NULL && usartBufferSize < ROBBUS_BULK_BLOCK_SIZE + BULK_HEADER_SIZE) {
+		byte* enlarged = (byte*) realloc(usartBuffer, ROBBUS_BULK_BLOCK_SIZE + BULK_HEADER_SIZE);
+		if (enlarged == NULL)
+			return;
+		usartBuffer = enlarged;
+		usartBufferSize = ROBBUS_BULK_BLOCK_SIZE + BULK_HEADER_SIZE;
+	}
+	bulkBuffer = buffer;
+	bulkCapacity = buffer != NULL ? size : 0;
+	bulkBlockSize = 0;
+}
+
+// length of the last bulk transfer once all its blocks are in the buffer, 0 before
+unsigned int RobbusLib::getBulkLength()
+{
+	if (bulkBlockSize && (unsigned long)bulkNext * bulkBlockSize >= bulkTotal)
+		return bulkTotal;
+	return 0;
+}
+
 // Private functions ///////////////////////////////////////////////////////////
 byte RobbusLib::doServiceCommand(void) {
 	byte newAddress;
@@ -290,11 +392,182 @@ byte RobbusLib::doServiceCommand(void) {
 			// TODO FIXME, EEPROM not found -- EEPROM.write(ROBBUS_EEPROM_DATA_ADDRESS+1, newAddress); 
 			payloadLength = 2;
 			return 1;
+		case SUBPACKET_CHANGED:
+			return doChangedCommand();
+		case SUBPACKET_BULK_BEGIN:
+		case SUBPACKET_BULK_WRITE:
+		case SUBPACKET_BULK_ACK:
+		case SUBPACKET_BULK_READ:
+			return doBulkCommand();
+		default:
+			return 0;
+	}
+}
+
+// process input of change only packet and reply with the output only if the host does not have it
+byte RobbusLib::doChangedCommand(void) {
+	byte* replyData;
+	byte fresh = inputSequence == 0;	// nothing received since reset, host state is unknown
+	byte hostSequence = usartBuffer[2];
+
+	if (payloadLength == CHANGED_HEADER_SIZE + incomingDataSize) {
+		memcpy(lastInput, usartBuffer + CHANGED_HEADER_SIZE, incomingDataSize);
+		inputSequence = usartBuffer[1];
+	} else if (payloadLength != CHANGED_HEADER_SIZE) {
+		return 0;
+	} else if (fresh || usartBuffer[1] != inputSequence) {
+		payloadLength = 0; // input missed, ask for it
+		return 1;
+	}
+
+	replyData = commandHandler(lastInput);
+	if (memcmp(replyData, lastOutput, outgoingDataSize) != 0) {
+		memcpy(lastOutput, replyData, outgoingDataSize);
+		if (++outputSequence == 0)
+			outputSequence = 1;
+	}
+
+	usartBuffer[0] = outputSequence;
+	payloadLength = 1;
+	if (fresh || hostSequence != outputSequence) {
+		memcpy(usartBuffer + 1, lastOutput, outgoingDataSize);
+		payloadLength += outgoingDataSize;
+	}
+	return 1;
+}
+
+// transfer blocks between the host and the bulk buffer
+byte RobbusLib::doBulkCommand(void) {
+	unsigned int value = usartBuffer[1] | (usartBuffer[2] << 8);
+	unsigned long offset;
+	byte length;
+
+	switch (usartBuffer[0])
+	{
+		case SUBPACKET_BULK_BEGIN:
+			if (payloadLength != 4)
+				return 0;
+			bulkBlockSize = 0;
+			bulkNext = 0;
+			bulkWindow = 0;
+			if (value <= bulkCapacity && usartBuffer[3] != 0) {
+				bulkTotal = value;
+				bulkBlockSize = usartBuffer[3] < ROBBUS_BULK_BLOCK_SIZE ? usartBuffer[3] : ROBBUS_BULK_BLOCK_SIZE;
+			}
+			usartBuffer[0] = bulkBlockSize;
+			usartBuffer[1] = bulkCapacity;
+			usartBuffer[2] = bulkCapacity >> 8;
+			payloadLength = 3;
+			return 1;
+		case SUBPACKET_BULK_WRITE:
+			// blocks outside the window or damaged ones are sent again after acknowledgement
+			offset = (unsigned long)value * bulkBlockSize;
+			length = payloadLength - BULK_HEADER_SIZE;
+			if (bulkBlockSize == 0 || payloadLength < BULK_HEADER_SIZE || value < bulkNext
+				|| value - bulkNext >= BULK_WINDOW || offset >= bulkTotal
+				|| length != (bulkTotal - offset < bulkBlockSize ? bulkTotal - offset : bulkBlockSize))
+				return 0;
+			memcpy(bulkBuffer + offset, usartBuffer + BULK_HEADER_SIZE, length);
+			bulkWindow |= 1 << (value - bulkNext);
+			while (bulkWindow & 1) {
+				bulkWindow >>= 1;
+				bulkNext++;
+			}
+			return 0;
+		case SUBPACKET_BULK_ACK:
+			usartBuffer[0] = bulkNext;
+			usartBuffer[1] = bulkNext >> 8;
+			usartBuffer[2] = bulkWindow;
+			payloadLength = 3;
+			return 1;
+		case SUBPACKET_BULK_READ:
+			if (payloadLength != 4)
+				return 0;
+			length = usartBuffer[3] < usartBufferSize ? usartBuffer[3] : usartBufferSize;
+			if (value >= bulkCapacity)
+				length = 0;
+			else if (bulkCapacity - value < length)
+				length = bulkCapacity - value;
+			memcpy(usartBuffer, bulkBuffer + value, length);
+			payloadLength = length;
+			return 1;
 		default:
 			return 0;
 	}
 }
 
+// next section or checksum, depending on what is left of the multi packet body
+#define multiNextSection() (multiRemaining ? MULTI_STATE_SECTION_ADDRESS : MULTI_STATE_CHECKSUM)
+
+// pick own section of a multi node packet, other sections are only checksummed
+void RobbusLib::doMultiPacket(byte data) {
+	byte flags = multiState & ~MULTI_STATE_MASK;
+
+	if ((multiState & MULTI_STATE_MASK) == MULTI_STATE_CHECKSUM) {
+		// no reply, other nodes may follow; short section would leave stale input in the buffer
+		if (((byte)(data + checkSum)) == 0 && (flags & MULTI_FLAG_RECEIVED)
+			&& payloadLength == incomingDataSize)
+			commandHandler(usartBuffer);
+		changeRxState(RX_STATE_READY);
+		return;
+	}
+
+	checkSumAdd(data);
+	if ((multiState & MULTI_STATE_MASK) == MULTI_STATE_LENGTH) {
+		multiRemaining = data;
+		multiState = multiNextSection();
+		return;
+	}
+	if (multiRemaining-- == 0) {
+		changeRxState(RX_STATE_READY); // sections longer than the body
+		return;
+	}
+
+	switch (multiState & MULTI_STATE_MASK) {
+		case MULTI_STATE_SECTION_ADDRESS:
+			flags &= ~MULTI_FLAG_OWN_SECTION;
+			if (data == deviceAddress)
+				flags |= MULTI_FLAG_OWN_SECTION;
+			multiState = flags | MULTI_STATE_SECTION_LENGTH;
+			break;
+		case MULTI_STATE_SECTION_LENGTH:
+			sectionRemaining = data;
+			if (flags & MULTI_FLAG_OWN_SECTION) {
+				payloadLength = data;
+				usartBufferIndex = 0;
+				if (data == 0)
+					flags |= MULTI_FLAG_RECEIVED;
+			}
+			multiState = flags | (data ? MULTI_STATE_SECTION_DATA : multiNextSection());
+			break;
+		case MULTI_STATE_SECTION_DATA:
+			if ((flags & MULTI_FLAG_OWN_SECTION) && usartBufferIndex < usartBufferSize)
+				usartBuffer[usartBufferIndex++] = data;
+			if (--sectionRemaining == 0) {
+				if (flags & MULTI_FLAG_OWN_SECTION)
+					flags |= MULTI_FLAG_RECEIVED;
+				multiState = flags | multiNextSection();
+			}
+			break;
+		default:
+			changeRxState(RX_STATE_READY);
+	}
+}
+
+// start transmitting the reply prepared in usartBuffer
+void RobbusLib::startReply(byte head)
+{
+	// initialize checksum
+	checkSumInit();
+
+	// set tx machine state
+	changeTxState(TX_STATE_SEND_ADDRESS);
+	clearFlag(RX_FLAG_SPECIAL_CHAR);
+
+	// and push first byte into usart register
+	commWrapper->write(head);
+}
+
 byte RobbusLib::sendWrapped(byte c)
 {
 	if (c > SPECIAL_CHAR_MAX) {
@@ -8,16 +8,21 @@
 
 #include "WProgram.h"
 
+// default bus speed, wrappers take other rate as constructor parameter
+#define ROBBUS_DEFAULT_BAUDRATE 115200L
+
 // abstract parent class for communication wrappers
 class RobbusCommWrapper
 {
 	public:
-		RobbusCommWrapper() {}
+		RobbusCommWrapper(long rate = ROBBUS_DEFAULT_BAUDRATE) : baudRate(rate) {}
 		virtual void begin() = 0;
 		virtual int available() = 0;
 		virtual int read() = 0;
 		virtual void write(byte) = 0;
-
+		long getBaudRate() { return baudRate; }
+	protected:
+		long baudRate;
 };
 
 class RobbusLib
@@ -26,6 +31,8 @@ class RobbusLib
 		RobbusLib();
 		void begin(RobbusCommWrapper* commWrapperPtr, byte address, byte inDataSize, byte outDataSize, byte* (*)(byte*));
 		void process();
+		void setBulkBuffer(byte* buffer, unsigned int size);
+		unsigned int getBulkLength();
 	private:
 		// data fields
 		RobbusCommWrapper* commWrapper;
@@ -39,10 +46,31 @@ class RobbusLib
 		byte usartBufferIndex;
 		byte incomingDataSize;
 		byte outgoingDataSize;
+		byte multiState;        //! multi node packet state and flags
+		byte multiRemaining;    //! multi node packet body bytes not received yet
+		byte sectionRemaining;  //! section payload bytes not received yet
+		byte groupRead;         //! GROUP_READ_FLAG and slot index of the current group packet
+		byte replyPending;      //! group read reply waits for its slot
+		unsigned long slotStart;  //! micros() at the end of the group read request
+		unsigned long slotDelay;  //! time from slotStart to the reply
+		byte* lastInput;        //! last input and output of change only packets
+		byte* lastOutput;
+		byte inputSequence;     //! sequence of lastInput, 0 until the host sends one
+		byte outputSequence;    //! sequence of lastOutput, never 0
+		byte* bulkBuffer;       //! bulk transfer target, NULL if not set
+		unsigned int bulkCapacity;
+		unsigned int bulkTotal;  //! length of the current bulk transfer
+		byte bulkBlockSize;     //! 0 when no transfer runs
+		unsigned int bulkNext;   //! first block not received
+		byte bulkWindow;        //! blocks received from bulkNext on, bit 0 is bulkNext
 
 		// private functions
 		byte doServiceCommand(void);
+		void doMultiPacket(byte data);
+		byte doChangedCommand(void);
+		byte doBulkCommand(void);
 		byte sendWrapped(byte c);		
+		void startReply(byte head);
 };
 
 // "singleton"
@@ -52,8 +80,8 @@ extern RobbusLib Robbus;
 class RobbusCommWrapper_Serial : public RobbusCommWrapper
 {
 	public:
-		RobbusCommWrapper_Serial() { }
-		virtual void begin() { Serial.begin(115200); }
+		RobbusCommWrapper_Serial(long rate = ROBBUS_DEFAULT_BAUDRATE) : RobbusCommWrapper(rate) { }
+		virtual void begin() { Serial.begin(baudRate); }
 		virtual int available() { return Serial.available(); }
 		virtual int read() { return Serial.read(); }
 		virtual void write(byte data) { Serial.write(data); }
@@ -64,8 +92,8 @@ class RobbusCommWrapper_Serial : public RobbusCommWrapper
 class RobbusCommWrapper_Serial1 : public RobbusCommWrapper
 {
 	public:
-		RobbusCommWrapper_Serial1() { }
-		virtual void begin() { Serial1.begin(115200); }
+		RobbusCommWrapper_Serial1(long rate = ROBBUS_DEFAULT_BAUDRATE) : RobbusCommWrapper(rate) { }
+		virtual void begin() { Serial1.begin(baudRate); }
 		virtual int available() { return Serial1.available(); }
 		virtual int read() { return Serial1.read(); }
 		virtual void write(byte data) { Serial1.write(data); }
@@ -76,8 +104,8 @@ class RobbusCommWrapper_Serial1 : public RobbusCommWrapper
 class RobbusCommWrapper_Serial2 : public RobbusCommWrapper
 {
 	public:
-		RobbusCommWrapper_Serial2() { }
-		virtual void begin() { Serial2.begin(115200); }
+		RobbusCommWrapper_Serial2(long rate = ROBBUS_DEFAULT_BAUDRATE) : RobbusCommWrapper(rate) { }
+		virtual void begin() { Serial2.begin(baudRate); }
 		virtual int available() { return Serial2.available(); }
 		virtual int read() { return Serial2.read(); }
 		virtual void write(byte data) { Serial2.write(data); }
@@ -88,8 +116,8 @@ class RobbusCommWrapper_Serial2 : public RobbusCommWrapper
 class RobbusCommWrapper_Serial3 : public RobbusCommWrapper
 {
 	public:
-		RobbusCommWrapper_Serial3() { }
-		virtual void begin() { Serial3.begin(115200); }
+		RobbusCommWrapper_Serial3(long rate = ROBBUS_DEFAULT_BAUDRATE) : RobbusCommWrapper(rate) { }
+		virtual void begin() { Serial3.begin(baudRate); }
 		virtual int available() { return Serial3.available(); }
 		virtual int read() { return Serial3.read(); }
 		virtual void write(byte data) { Serial3.write(data); }
@@ -101,8 +129,8 @@ class RobbusCommWrapper_Serial3 : public RobbusCommWrapper
 class RobbusCommWrapper_Serial4 : public RobbusCommWrapper
 {
 	public:
-		RobbusCommWrapper_Serial4() { }
-		virtual void begin() { Serial4.begin(115200); }
+		RobbusCommWrapper_Serial4(long rate = ROBBUS_DEFAULT_BAUDRATE) : RobbusCommWrapper(rate) { }
+		virtual void begin() { Serial4.begin(baudRate); }
 		virtual int available() { return Serial4.available(); }
 		virtual int read() { return Serial4.read(); }
 		virtual void write(byte data) { Serial4.write(data); }
@@ -111,8 +139,8 @@ class RobbusCommWrapper_Serial4 : public RobbusCommWrapper
 class RobbusCommWrapper_Serial5 : public RobbusCommWrapper
 {
 	public:
-		RobbusCommWrapper_Serial5() { }
-		virtual void begin() { Serial5.begin(115200); }
+		RobbusCommWrapper_Serial5(long rate = ROBBUS_DEFAULT_BAUDRATE) : RobbusCommWrapper(rate) { }
+		virtual void begin() { Serial5.begin(baudRate); }
 		virtual int available() { return Serial5.available(); }
 		virtual int read() { return Serial5.read(); }
 		virtual void write(byte data) { Serial5.write(data); }
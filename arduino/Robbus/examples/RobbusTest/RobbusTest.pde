@@ -12,8 +12,8 @@ byte outData[2];
 // class RobbusCommWrapper_MyOwn : public RobbusCommWrapper
 // {
 //   public:
-//     RobbusCommWrapper_MyOwn() { MyCommLayer myCommLayer = MyCommLayer(); }
-//     virtual void begin() { myCommLayer.initialize(115200); }
+//     RobbusCommWrapper_MyOwn(long rate) : RobbusCommWrapper(rate) { MyCommLayer myCommLayer = MyCommLayer(); }
+//     virtual void begin() { myCommLayer.initialize(baudRate); }
 //     virtual int available() { return myCommLayer.areDataReady(); }
 //     virtual int read() { return myCommLayer.getData(); }
 //     virtual void write(uint8_t data) { myCommLayer.sendData(data); }
@@ -21,6 +21,8 @@ byte outData[2];
 //     MyCommLayer myCommLayer;
 //}; 
 // for Maple IDE use RobbusCommWrapper_SerialX where X=(1, 2, 3, USB) instead (Serial w/o suffix is not supported)
+// the wrappers take the bus speed as optional parameter (115200 by default),
+// e.g. RobbusCommWrapper_Serial(500000) for 500 kbaud bus
 RobbusCommWrapper_Serial RobbusOnSerial = RobbusCommWrapper_Serial();
 
 // message handler 
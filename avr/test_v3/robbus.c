@@ -25,6 +25,11 @@
 #define SUBPACKET_ECHO 'e'
 #define SUBPACKET_DESCRIPTION 'd'
 #define SUBPACKET_CHANGE_ADDRESS 'a'
+#define SUBPACKET_CHANGED 'c'
+#define SUBPACKET_BULK_BEGIN 'B'
+#define SUBPACKET_BULK_WRITE 'W'
+#define SUBPACKET_BULK_ACK 'K'
+#define SUBPACKET_BULK_READ 'R'
 // message processing machine state
 // RX states - bits 2:0
  enum RxStateEnum  {
@@ -38,9 +43,68 @@
 	RX_STATE_WAIT_FOR_ADDRESS = 0x03,
 	RX_STATE_WAIT_FOR_LENGTH = 0x04,
 	RX_STATE_WAIT_FOR_DATA = 0x05,
-	RX_STATE_WAIT_FOR_CHECKSUM = 0x06
+	RX_STATE_WAIT_FOR_CHECKSUM = 0x06,
+
+	// multi node packet, details in multiState
+	RX_STATE_MULTI = 0x07
+};
+
+// multi node packet states - bits 2:0 of multiState
+// regular head, address MULTI_PACKET_ADDRESS, body length, sections
+// (address, length, payload) and checksum of everything after the head
+enum MultiStateEnum {
+	MULTI_STATE_LENGTH = 0x00,
+	MULTI_STATE_SECTION_ADDRESS = 0x01,
+	MULTI_STATE_SECTION_LENGTH = 0x02,
+	MULTI_STATE_SECTION_DATA = 0x03,
+	MULTI_STATE_CHECKSUM = 0x04
 };
 
+// multi node packet flags - bits 7:6 of multiState
+#define MULTI_FLAG_OWN_SECTION		0x80	//! current section is for this node
+#define MULTI_FLAG_RECEIVED		0x40	//! own section complete
+
+#define MULTI_STATE_MASK 0x07
+
+// reply address of nonexistent node 0, ignored by nodes not knowing multi packets
+#define MULTI_PACKET_ADDRESS 0x80
+
+// group read packet: group head, address with this bit set, mask, length,
+// slot width and regular payload. Every matching node replies in its slot,
+// the slot index is the part of the address not covered by the mask.
+#define GROUP_READ_FLAG 0x80
+
+// slot width unit in microseconds
+#define GROUP_READ_SLOT_UNIT_US 10
+
+#ifndef ROBBUS_GROUP_READ
+#define ROBBUS_GROUP_READ 0
+#endif
+
+// change only service subpacket: 'c', input sequence, output sequence known
+// to the host and the input if it changed (the last one is used otherwise).
+// Reply is output sequence followed by the output if the host does not have
+// it yet, empty reply asks for the input again. Sequence 0 means none.
+#define CHANGED_HEADER_SIZE 3
+
+#ifndef ROBBUS_CHANGE_ONLY
+#define ROBBUS_CHANGE_ONLY 0
+#endif
+
+// bulk transfer into the buffer given by Robbus_SetBulkBuffer(), 16 bit values little endian:
+// 'B', total length, block size - starts transfer, reply is block size accepted
+//      (0 if refused) and buffer capacity
+// 'W', block index, data - block of the transfer, no reply
+// 'K' - reply is index of the first missing block and bitmap of received blocks from it
+// 'R', offset, length - reply is buffer content
+#define BULK_HEADER_SIZE 3
+// blocks the host may send before asking for acknowledgement
+#define BULK_WINDOW 8
+
+#ifndef ROBBUS_BULK_BLOCK_SIZE
+#define ROBBUS_BULK_BLOCK_SIZE 0
+#endif
+
 // TX states - bits 4:3
 enum TxStateEnum  {
 	TX_STATE_READY = 0x00,
@@ -78,6 +142,34 @@ enum TxStateEnum  {
 // value added to the address while composing the reply	
 #define ADDRESS_REPLY_MASK 0x80
 
+// baudrate register values for normal and double speed mode
+#if ROBBUS_BAUDRATE*8L > ROBBUS_CPU_FREQ
+#error "ROBBUS_BAUDRATE is too high for ROBBUS_CPU_FREQ"
+#endif
+#ifndef ROBBUS_BAUDRATE_TOLERANCE
+#define ROBBUS_BAUDRATE_TOLERANCE 20
+#endif
+#define UBRR_1X ((ROBBUS_CPU_FREQ+(ROBBUS_BAUDRATE*8L))/(ROBBUS_BAUDRATE*16L)-1)
+#define UBRR_2X ((ROBBUS_CPU_FREQ+(ROBBUS_BAUDRATE*4L))/(ROBBUS_BAUDRATE*8L)-1)
+#define BAUDRATE_1X (ROBBUS_CPU_FREQ/(16L*(UBRR_1X+1)))
+#define BAUDRATE_2X (ROBBUS_CPU_FREQ/(8L*(UBRR_2X+1)))
+#define BAUDRATE_ERROR(real) ((((real)>ROBBUS_BAUDRATE)?((real)-ROBBUS_BAUDRATE):(ROBBUS_BAUDRATE-(real)))*1000L/ROBBUS_BAUDRATE)
+
+// prefer normal mode (better noise immunity) unless double speed is more precise
+#if BAUDRATE_ERROR(BAUDRATE_1X) <= BAUDRATE_ERROR(BAUDRATE_2X)
+#define USE_2X 0
+#define UBRR_VALUE UBRR_1X
+#define BAUDRATE_REAL_ERROR BAUDRATE_ERROR(BAUDRATE_1X)
+#else
+#define USE_2X 1
+#define UBRR_VALUE UBRR_2X
+#define BAUDRATE_REAL_ERROR BAUDRATE_ERROR(BAUDRATE_2X)
+#endif
+
+#if BAUDRATE_REAL_ERROR > ROBBUS_BAUDRATE_TOLERANCE
+#error "ROBBUS_BAUDRATE can't be reached with ROBBUS_CPU_FREQ within ROBBUS_BAUDRATE_TOLERANCE"
+#endif
+
 // command handler function type definition and variable
 static PtrFuncPtr_t commandHandler;
 
@@ -87,11 +179,32 @@ static volatile uint8_t payloadLength;
 static volatile uint8_t checkSum;
 static volatile uint8_t deviceAddress;
 
+// multi node packet processing
+static volatile uint8_t multiState;
+static volatile uint8_t multiRemaining;		//! body bytes not received yet
+static volatile uint8_t sectionRemaining;	//! section payload bytes not received yet
+
 // data buffers
 #define ROBBUS_MIN_BUFFER_SIZE 4
-#define RX_SIZE (ROBBUS_INCOMMING_SIZE>ROBBUS_MIN_BUFFER_SIZE?ROBBUS_INCOMMING_SIZE:ROBBUS_MIN_BUFFER_SIZE)
-#define TX_SIZE (ROBBUS_OUTGOING_SIZE)
-#define USART_BUFFER_SIZE (RX_SIZE>TX_SIZE?RX_SIZE:TX_SIZE)
+// bytes preceding the input: slot width of group read, sequences of change only packet
+#if ROBBUS_CHANGE_ONLY
+#define RX_HEADER_SIZE CHANGED_HEADER_SIZE
+#elif ROBBUS_GROUP_READ
+#define RX_HEADER_SIZE 1
+#else
+#define RX_HEADER_SIZE 0
+#endif
+#define RX_PAYLOAD_SIZE (ROBBUS_INCOMMING_SIZE+RX_HEADER_SIZE)
+#define RX_SIZE (RX_PAYLOAD_SIZE>ROBBUS_MIN_BUFFER_SIZE?RX_PAYLOAD_SIZE:ROBBUS_MIN_BUFFER_SIZE)
+// output sequence precedes the change only reply
+#define TX_SIZE (ROBBUS_OUTGOING_SIZE+ROBBUS_CHANGE_ONLY)
+#define BULK_SIZE (ROBBUS_BULK_BLOCK_SIZE+BULK_HEADER_SIZE)
+#define USART_MESSAGE_SIZE (RX_SIZE>TX_SIZE?RX_SIZE:TX_SIZE)
+#if ROBBUS_BULK_BLOCK_SIZE
+#define USART_BUFFER_SIZE (USART_MESSAGE_SIZE>BULK_SIZE?USART_MESSAGE_SIZE:BULK_SIZE)
+#else
+#define USART_BUFFER_SIZE USART_MESSAGE_SIZE
+#endif
 static uint8_t usartBuffer[USART_BUFFER_SIZE];
 
 // working positions in the buffers
@@ -99,8 +212,36 @@ static uint8_t volatile usartBufferIndex;
 // this shadows the received address to the same memory (as they're not needed at the same time
 #define receivedAddress usartBufferIndex
 
+#if ROBBUS_CHANGE_ONLY
+// last input and output, change only packets carry them only when they differ
+static uint8_t lastInput[ROBBUS_INCOMMING_SIZE];
+static uint8_t lastOutput[ROBBUS_OUTGOING_SIZE];
+static uint8_t inputSequence;	//! sequence of lastInput, 0 until the host sends one
+static uint8_t outputSequence;	//! sequence of lastOutput, never 0
+#endif
+
+#if ROBBUS_BULK_BLOCK_SIZE
+static uint8_t *bulkBuffer;
+static uint16_t bulkCapacity;
+static uint16_t bulkTotal;	//! length of the current transfer
+static uint8_t bulkBlockSize;	//! 0 when no transfer runs
+static uint16_t bulkNext;	//! first block not received
+static uint8_t bulkWindow;	//! blocks received from bulkNext on, bit 0 is bulkNext
+#endif
+
+#if ROBBUS_GROUP_READ
+static volatile uint8_t groupRead;	//! GROUP_READ_FLAG and slot index of the current group packet
+#endif
+
 // forward declarations
 uint8_t doServiceCommand(void);
+#if ROBBUS_CHANGE_ONLY
+static uint8_t doChangedCommand(void);
+#endif
+#if ROBBUS_BULK_BLOCK_SIZE
+static uint8_t doBulkCommand(void);
+#endif
+static void doMultiPacket(uint8_t data);
 
 #define checkSumInit() checkSum = 0
 #define checkSumAdd(data) checkSum += data;
@@ -124,6 +265,50 @@ static uint8_t sendWrapped(uint8_t c)
 	return 1;
 }
 
+/// start transmitting the reply prepared in usartBuffer
+static void startReply(uint8_t head)
+{
+	// initialize checksum
+	checkSumInit();
+
+	// set tx machine state
+	changeTxState(TX_STATE_SEND_ADDRESS);
+	clearFlag(RX_FLAG_SPECIAL_CHAR);
+
+	// and push first byte into usart register
+	UDR = head;
+}
+
+#if ROBBUS_GROUP_READ
+/*!
+* \brief start the reply of a group read after the given number of slot units
+*
+* Timer1 runs from the clock divided by 256 and is stopped again by the compare interrupt.
+*/
+static void startSlotTimer(uint16_t units)
+{
+	uint32_t ticks = (uint32_t)units * (ROBBUS_CPU_FREQ/1000L) / (256000L/GROUP_READ_SLOT_UNIT_US);
+	if (ticks == 0)
+		ticks = 1;
+	if (ticks > 0xffff)
+		ticks = 0xffff;
+
+	TCCR1B = 0;
+	TCNT1 = 0;
+	OCR1A = ticks;
+	TIFR = _BV(OCF1A);
+	TIMSK |= _BV(OCIE1A);
+	TCCR1B = _BV(CS12);
+}
+
+/// slot of this node reached, send the group read reply
+ISR(TIMER1_COMPA_vect) {
+	TCCR1B = 0;
+	TIMSK &= ~_BV(OCIE1A);
+	startReply(REGULAR_PACKET_HEAD);
+}
+#endif
+
 //! initialize FSM
 void Robbus_Init(PtrFuncPtr_t cmdHandler) {
 	// Initialize UART:
@@ -132,7 +317,12 @@ void Robbus_Init(PtrFuncPtr_t cmdHandler) {
 	UCSRB = _BV(RXCIE) | _BV(TXCIE) | _BV(RXEN) | _BV(TXEN);
 
 	// set baudrate
-	uint16_t baudrate = ((ROBBUS_CPU_FREQ+(ROBBUS_BAUDRATE*8L))/(ROBBUS_BAUDRATE*16L)-1);
+	uint16_t baudrate = UBRR_VALUE;
+#if USE_2X
+	UCSRA |= _BV(U2X);
+#else
+	UCSRA &= ~_BV(U2X);
+#endif
 	UBRRL = baudrate;
 	#ifdef UBRRH
 	UBRRH = baudrate >> 8;
@@ -151,6 +341,11 @@ void Robbus_Init(PtrFuncPtr_t cmdHandler) {
 	// initialize buffer indices
 	usartBufferIndex = 0;
 
+#if ROBBUS_CHANGE_ONLY
+	inputSequence = 0;
+	outputSequence = 1;
+#endif
+
 	// register application command handler
 	commandHandler = cmdHandler;
 }
@@ -160,14 +355,19 @@ void Robbus_Init(PtrFuncPtr_t cmdHandler) {
 ISR(USART_RXC_vect) {
 	// read byte from USART register
 	uint8_t data = UDR;
+#if ROBBUS_GROUP_READ
+	uint8_t replyNow = 0;	// group read reply in the first slot
+#endif
 
 	// special characters handling
 	if (data == SERVICE_PACKET_HEAD) {			// service packet
 		setFlag(RX_FLAG_SERVICE_PACKET);		// set flag
+		clearFlag(RX_FLAG_GROUP_PACKET);		// clear flags
 		changeRxState(RX_STATE_WAIT_FOR_ADDRESS);	// and process as regular
 		return;						// and leave processing
 	} else if (data == GROUP_PACKET_HEAD) {			// group packet (will contain mask byte)
 		setFlag(RX_FLAG_GROUP_PACKET);			// set flag
+		clearFlag(RX_FLAG_SERVICE_PACKET);		// clear flags
 		changeRxState(RX_STATE_WAIT_FOR_GROUP_ADDRESS);	// and wait for composite address (address-mask)
 		return;						// and leave processing
 	} else if (data == REGULAR_PACKET_HEAD) {		// regular packet
@@ -187,20 +387,28 @@ ISR(USART_RXC_vect) {
 	switch (getRxState()) {
 		// group sequence	
 		case RX_STATE_WAIT_FOR_GROUP_ADDRESS:
+#if ROBBUS_GROUP_READ
+			groupRead = data & GROUP_READ_FLAG;
+#else
 			if (data & ADDRESS_REPLY_MASK) {
-				changeRxState(RX_STATE_READY); // reply from someone (even me ;), ignore rest of packet
-			} else {
-				receivedAddress = data;
-				checkSumInit();
-				checkSumAdd(data);
-				changeRxState(RX_STATE_WAIT_FOR_GROUP_MASK);
+				changeRxState(RX_STATE_READY); // group read not supported, ignore rest of packet
+				break;
 			}
+#endif
+			receivedAddress = data & ~GROUP_READ_FLAG;
+			checkSumInit();
+			checkSumAdd(data);
+			changeRxState(RX_STATE_WAIT_FOR_GROUP_MASK);
 			break;
 
 		case RX_STATE_WAIT_FOR_GROUP_MASK:
 			if ((data & receivedAddress) != (data & deviceAddress)) {
 				changeRxState(RX_STATE_READY); // reply from someone, ignore rest of packet
 			} else {
+#if ROBBUS_GROUP_READ
+				if (groupRead)
+					groupRead |= deviceAddress & ~data & ~GROUP_READ_FLAG;
+#endif
 				receivedAddress = data;
 				checkSumAdd(data);
 				changeRxState(RX_STATE_WAIT_FOR_LENGTH);
@@ -209,7 +417,12 @@ ISR(USART_RXC_vect) {
 		
 		// regulsr sequence	
 		case RX_STATE_WAIT_FOR_ADDRESS:
-			if (data & ADDRESS_REPLY_MASK || data != deviceAddress) {
+			if (data == MULTI_PACKET_ADDRESS && !getFlag(RX_FLAG_SERVICE_PACKET|RX_FLAG_GROUP_PACKET)) {
+				checkSumInit();
+				checkSumAdd(data);
+				multiState = MULTI_STATE_LENGTH;
+				changeRxState(RX_STATE_MULTI);
+			} else if (data & ADDRESS_REPLY_MASK || data != deviceAddress) {
 				changeRxState(RX_STATE_READY); // reply from someone, or for another one ignore rest of packet
 			} else {
 				checkSumInit();
@@ -247,9 +460,25 @@ ISR(USART_RXC_vect) {
 						return;
 					}
 				} else {
-					uint8_t i;
+					uint8_t i, *inData = usartBuffer;
+#if ROBBUS_GROUP_READ
+					if (getFlag(RX_FLAG_GROUP_PACKET) && groupRead) {
+						// the first byte is slot width, slots count from the end of
+						// the request, so start timing before the handler
+						uint16_t slotDelay = (groupRead & ~GROUP_READ_FLAG) * usartBuffer[0];
+						if (payloadLength == 0) {
+							changeRxState(RX_STATE_READY);
+							return;
+						}
+						if (slotDelay)
+							startSlotTimer(slotDelay);
+						else
+							replyNow = 1;
+						inData++;
+					}
+#endif
 					// process regular packet
-					uint8_t* replyData = commandHandler(usartBuffer);
+					uint8_t* replyData = commandHandler(inData);
 
 					// copy user data to uart buffer
 					for (i = 0; i < ROBBUS_OUTGOING_SIZE; i++)
@@ -260,21 +489,20 @@ ISR(USART_RXC_vect) {
 				
 				// if not group packet, send reply
 				if (!(getFlag(RX_FLAG_GROUP_PACKET)))
-				{
-					// initialize checksum
-					checkSumInit();
-
-					// set tx machine state
-					changeTxState(TX_STATE_SEND_ADDRESS);
-					clearFlag(RX_FLAG_SPECIAL_CHAR);
-
-					// and push first byte into usart register
-					UDR = getFlag(RX_FLAG_SERVICE_PACKET) ? SERVICE_PACKET_HEAD : REGULAR_PACKET_HEAD;
-				}
+					startReply(getFlag(RX_FLAG_SERVICE_PACKET) ? SERVICE_PACKET_HEAD : REGULAR_PACKET_HEAD);
+#if ROBBUS_GROUP_READ
+				// group read, the first slot replies at once, others wait for the timer
+				else if (replyNow)
+					startReply(REGULAR_PACKET_HEAD);
+#endif
 			}
 			changeRxState(RX_STATE_READY);
 			break;
 
+		case RX_STATE_MULTI:
+			doMultiPacket(data);
+			break;
+
 		default:
 			// should never happen ;-)
 			changeRxState(RX_STATE_READY);
@@ -314,6 +542,64 @@ ISR(USART_TXC_vect) {
 	}
 }
 
+/// next section or checksum, depending on what is left of the multi packet body
+#define multiNextSection() (multiRemaining ? MULTI_STATE_SECTION_ADDRESS : MULTI_STATE_CHECKSUM)
+
+/// pick own section of a multi node packet, other sections are only checksummed
+static void doMultiPacket(uint8_t data) {
+	uint8_t flags = multiState & ~MULTI_STATE_MASK;
+
+	if ((multiState & MULTI_STATE_MASK) == MULTI_STATE_CHECKSUM) {
+		// no reply, other nodes may follow; short section would leave stale input in the buffer
+		if (((uint8_t)(data + checkSum)) == 0 && (flags & MULTI_FLAG_RECEIVED)
+			&& payloadLength == ROBBUS_INCOMMING_SIZE)
+			commandHandler(usartBuffer);
+		changeRxState(RX_STATE_READY);
+		return;
+	}
+
+	checkSumAdd(data);
+	if ((multiState & MULTI_STATE_MASK) == MULTI_STATE_LENGTH) {
+		multiRemaining = data;
+		multiState = multiNextSection();
+		return;
+	}
+	if (multiRemaining-- == 0) {
+		changeRxState(RX_STATE_READY); // sections longer than the body
+		return;
+	}
+
+	switch (multiState & MULTI_STATE_MASK) {
+		case MULTI_STATE_SECTION_ADDRESS:
+			flags &= ~MULTI_FLAG_OWN_SECTION;
+			if (data == deviceAddress)
+				flags |= MULTI_FLAG_OWN_SECTION;
+			multiState = flags | MULTI_STATE_SECTION_LENGTH;
+			break;
+		case MULTI_STATE_SECTION_LENGTH:
+			sectionRemaining = data;
+			if (flags & MULTI_FLAG_OWN_SECTION) {
+				payloadLength = data;
+				usartBufferIndex = 0;
+				if (data == 0)
+					flags |= MULTI_FLAG_RECEIVED;
+			}
+			multiState = flags | (data ? MULTI_STATE_SECTION_DATA : multiNextSection());
+			break;
+		case MULTI_STATE_SECTION_DATA:
+			if ((flags & MULTI_FLAG_OWN_SECTION) && usartBufferIndex < USART_BUFFER_SIZE)
+				usartBuffer[usartBufferIndex++] = data;
+			if (--sectionRemaining == 0) {
+				if (flags & MULTI_FLAG_OWN_SECTION)
+					flags |= MULTI_FLAG_RECEIVED;
+				multiState = flags | multiNextSection();
+			}
+			break;
+		default:
+			changeRxState(RX_STATE_READY);
+	}
+}
+
 uint8_t doServiceCommand(void) {
 	uint8_t newAddress;
 	switch (usartBuffer[0])
@@ -334,8 +620,135 @@ uint8_t doServiceCommand(void) {
 			//deviceAddress = newAddress;	
 			payloadLength = 2;
 			return 1;
+#if ROBBUS_CHANGE_ONLY
+		case SUBPACKET_CHANGED:
+			return doChangedCommand();
+#endif
+#if ROBBUS_BULK_BLOCK_SIZE
+		case SUBPACKET_BULK_BEGIN:
+		case SUBPACKET_BULK_WRITE:
+		case SUBPACKET_BULK_ACK:
+		case SUBPACKET_BULK_READ:
+			return doBulkCommand();
+#endif
 		default:
 			return 0;
 	}
 }
 
+#if ROBBUS_BULK_BLOCK_SIZE
+void Robbus_SetBulkBuffer(uint8_t *buffer, uint16_t size) {
+	cli();
+	bulkBuffer = buffer;
+	bulkCapacity = buffer != NULL ? size : 0;
+	bulkBlockSize = 0;
+	sei();
+}
+
+uint16_t Robbus_GetBulkLength(void) {
+	uint16_t length = 0;
+	cli();
+	if (bulkBlockSize && (uint32_t)bulkNext * bulkBlockSize >= bulkTotal)
+		length = bulkTotal;
+	sei();
+	return length;
+}
+
+/// transfer blocks between the host and the bulk buffer
+static uint8_t doBulkCommand(void) {
+	uint16_t value = usartBuffer[1] | (usartBuffer[2] << 8);
+	uint32_t offset;
+	uint8_t length;
+
+	switch (usartBuffer[0]) {
+		case SUBPACKET_BULK_BEGIN:
+			if (payloadLength != 4)
+				return 0;
+			bulkBlockSize = 0;
+			bulkNext = 0;
+			bulkWindow = 0;
+			if (value <= bulkCapacity && usartBuffer[3] != 0) {
+				bulkTotal = value;
+				bulkBlockSize = usartBuffer[3] < ROBBUS_BULK_BLOCK_SIZE ? usartBuffer[3] : ROBBUS_BULK_BLOCK_SIZE;
+			}
+			usartBuffer[0] = bulkBlockSize;
+			usartBuffer[1] = bulkCapacity;
+			usartBuffer[2] = bulkCapacity >> 8;
+			payloadLength = 3;
+			return 1;
+
+		case SUBPACKET_BULK_WRITE:
+			// blocks outside the window or damaged ones are sent again after acknowledgement
+			offset = (uint32_t)value * bulkBlockSize;
+			length = payloadLength - BULK_HEADER_SIZE;
+			if (bulkBlockSize == 0 || payloadLength < BULK_HEADER_SIZE || value < bulkNext
+				|| value - bulkNext >= BULK_WINDOW || offset >= bulkTotal
+				|| length != (bulkTotal - offset < bulkBlockSize ? bulkTotal - offset : bulkBlockSize))
+				return 0;
+			memcpy(bulkBuffer + offset, usartBuffer + BULK_HEADER_SIZE, length);
+			bulkWindow |= 1 << (value - bulkNext);
+			while (bulkWindow & 1) {
+				bulkWindow >>= 1;
+				bulkNext++;
+			}
+			return 0;
+
+		case SUBPACKET_BULK_ACK:
+			usartBuffer[0] = bulkNext;
+			usartBuffer[1] = bulkNext >> 8;
+			usartBuffer[2] = bulkWindow;
+			payloadLength = 3;
+			return 1;
+
+		case SUBPACKET_BULK_READ:
+			if (payloadLength != 4)
+				return 0;
+			length = usartBuffer[3] < USART_BUFFER_SIZE ? usartBuffer[3] : USART_BUFFER_SIZE;
+			if (value >= bulkCapacity)
+				length = 0;
+			else if (bulkCapacity - value < length)
+				length = bulkCapacity - value;
+			memcpy(usartBuffer, bulkBuffer + value, length);
+			payloadLength = length;
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+#endif
+
+#if ROBBUS_CHANGE_ONLY
+/// process input of change only packet and reply with the output only if the host does not have it
+static uint8_t doChangedCommand(void) {
+	uint8_t *replyData;
+	uint8_t fresh = inputSequence == 0;	// nothing received since reset, host state is unknown
+	uint8_t hostSequence = usartBuffer[2];
+
+	if (payloadLength == CHANGED_HEADER_SIZE + ROBBUS_INCOMMING_SIZE) {
+		memcpy(lastInput, usartBuffer + CHANGED_HEADER_SIZE, ROBBUS_INCOMMING_SIZE);
+		inputSequence = usartBuffer[1];
+	} else if (payloadLength != CHANGED_HEADER_SIZE) {
+		return 0;
+	} else if (fresh || usartBuffer[1] != inputSequence) {
+		payloadLength = 0; // input missed, ask for it
+		return 1;
+	}
+
+	replyData = commandHandler(lastInput);
+	if (memcmp(replyData, lastOutput, ROBBUS_OUTGOING_SIZE) != 0) {
+		memcpy(lastOutput, replyData, ROBBUS_OUTGOING_SIZE);
+		if (++outputSequence == 0)
+			outputSequence = 1;
+	}
+
+	usartBuffer[0] = outputSequence;
+	payloadLength = 1;
+	if (fresh || hostSequence != outputSequence) {
+		memcpy(usartBuffer + 1, lastOutput, ROBBUS_OUTGOING_SIZE);
+		payloadLength += ROBBUS_OUTGOING_SIZE;
+	}
+	return 1;
+}
+#endif
+
@@ -24,6 +24,13 @@ typedef uint8_t* (*PtrFuncPtr_t)(uint8_t*);
 //! initialize FSM
 void Robbus_Init(PtrFuncPtr_t cmdHandler);
 
+#if ROBBUS_BULK_BLOCK_SIZE
+//! buffer bulk transfers write to and read from
+void Robbus_SetBulkBuffer(uint8_t *buffer, uint16_t size);
+//! length of the last bulk transfer once all its blocks are in the buffer, 0 before
+uint16_t Robbus_GetBulkLength(void);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
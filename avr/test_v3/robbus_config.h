@@ -15,9 +15,12 @@
 /// clock speed
 #define ROBBUS_CPU_FREQ 18432000L
 
-/// bus baudrate
+/// bus baudrate (double speed mode is selected automatically when it gets closer)
 #define ROBBUS_BAUDRATE 115200L
 
+/// maximal allowed baudrate error in per mille, compilation fails above it
+#define ROBBUS_BAUDRATE_TOLERANCE 20
+
 /// initial robbus address of the device (if not able to read from the EEPROM)
 #define ROBBUS_INITIAL_ADDRESS 'r'
 
@@ -30,4 +33,13 @@
 /// output buffer size. Change to match the outgoing payload size
 #define ROBBUS_OUTGOING_SIZE 1
 
+/// reply to group read packets in time slots (uses Timer1), 0 to disable
+#define ROBBUS_GROUP_READ 1
+
+/// answer change only packets (keeps copy of the last input and output), 0 to disable
+#define ROBBUS_CHANGE_ONLY 1
+
+/// longest block of bulk transfers (enlarges the receive buffer), 0 to disable
+#define ROBBUS_BULK_BLOCK_SIZE 16
+
 #endif
@@ -0,0 +1,325 @@
+/*!
+* \file RobbusAsync.c
+* \brief queued transactions driven by a bus thread
+*
+* The bus thread takes everything submitted so far at once, orders it by
+* deadline and runs it. Requests dropping their reply (regular tag, reply NULL)
+* are packed together into multi node packets.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "RobbusAsync.h"
+#include "RobbusFrame.h"
+
+struct RobbusAsync {
+	RobbusComm_t	*comm;
+	pthread_t	thread;
+	pthread_mutex_t	lock;
+	pthread_cond_t	submitted;	//! new transaction or stop request
+	pthread_cond_t	completed;	//! new entry in the completion queue
+	int		stop;
+	RobbusAsync_Transaction_t *pending;	//! submitted, not taken by the bus thread yet
+	RobbusAsync_Transaction_t *completionHead;
+	RobbusAsync_Transaction_t *completionTail;
+};
+
+static int RobbusAsync_HasDeadline(const RobbusAsync_Transaction_t *transaction) {
+	return transaction->deadline.tv_sec != 0 || transaction->deadline.tv_nsec != 0;
+}
+
+static int RobbusAsync_TimeBefore(const struct timespec *a, const struct timespec *b) {
+	return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/// earlier deadline first, transactions without deadline go last
+static int RobbusAsync_Before(const RobbusAsync_Transaction_t *a, const RobbusAsync_Transaction_t *b) {
+	if (!RobbusAsync_HasDeadline(b))
+		return RobbusAsync_HasDeadline(a);
+	if (!RobbusAsync_HasDeadline(a))
+		return 0;
+	return RobbusAsync_TimeBefore(&a->deadline, &b->deadline);
+}
+
+static void RobbusAsync_Complete(RobbusAsync_t *async, RobbusAsync_Transaction_t *transaction, int result) {
+	transaction->result = result;
+	transaction->next = NULL;
+	if (transaction->callback != NULL) {
+		transaction->callback(transaction);
+		return;
+	}
+
+	pthread_mutex_lock(&async->lock);
+	if (async->completionTail != NULL)
+		async->completionTail->next = transaction;
+	else
+		async->completionHead = transaction;
+	async->completionTail = transaction;
+	pthread_cond_broadcast(&async->completed);
+	pthread_mutex_unlock(&async->lock);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief sort list by deadline, stable merge sort
+*/
+static RobbusAsync_Transaction_t *RobbusAsync_MergeSort(RobbusAsync_Transaction_t *list) {
+	RobbusAsync_Transaction_t *half = list, *fast, *sorted = NULL, **tail = &sorted;
+
+	if (list == NULL || list->next == NULL)
+		return list;
+	for (fast = list->next; fast != NULL && fast->next != NULL; fast = fast->next->next)
+		half = half->next;
+	fast = half->next;
+	half->next = NULL;
+
+	list = RobbusAsync_MergeSort(list);
+	fast = RobbusAsync_MergeSort(fast);
+	while (list != NULL && fast != NULL) {
+		// take the second half only when strictly earlier, equal ones keep their order
+		RobbusAsync_Transaction_t **first = RobbusAsync_Before(fast, list) ? &fast : &list;
+		*tail = *first;
+		tail = &(*first)->next;
+		*first = (*first)->next;
+	}
+	*tail = list != NULL ? list : fast;
+	return sorted;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief sort taken transactions by deadline, submit order is kept otherwise
+*
+* The pending list is built by prepending, so it is reversed first.
+*/
+static RobbusAsync_Transaction_t *RobbusAsync_Sort(RobbusAsync_Transaction_t *list) {
+	RobbusAsync_Transaction_t *reversed = NULL;
+
+	while (list != NULL) {
+		RobbusAsync_Transaction_t *next = list->next;
+		list->next = reversed;
+		reversed = list;
+		list = next;
+	}
+	return RobbusAsync_MergeSort(reversed);
+}
+
+static int RobbusAsync_IsWrite(const RobbusAsync_Transaction_t *transaction) {
+	return transaction->reply == NULL && transaction->tag == ROBBUS_TAG_REGULAR
+		&& ROBBUS_MULTI_SECTION_OVERHEAD + transaction->size <= ROBBUS_MULTI_BODY_MAX;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief write the first transaction and the writes right after it by one multi node packet
+*
+* Only writes up to the next other transaction are taken, so the deadline
+* order is kept. Expired ones among them complete with RBC_TIMEOUT.
+*
+* \return rest of the list with the written transactions removed
+*/
+static RobbusAsync_Transaction_t *RobbusAsync_RunWrites(RobbusAsync_t *async, RobbusAsync_Transaction_t *list) {
+	RobbusAsync_Transaction_t *batch = NULL, **batchTail = &batch, *transaction;
+	RobbusFrame_Builder_t builder;
+	uint8_t frame[ROBBUS_FRAME_MAX_SIZE];
+	struct timespec now;
+	size_t body = 0;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	while (list != NULL && RobbusAsync_IsWrite(list)) {
+		size_t section;
+		transaction = list;
+		if (RobbusAsync_HasDeadline(transaction) && RobbusAsync_TimeBefore(&transaction->deadline, &now)) {
+			list = transaction->next;
+			RobbusAsync_Complete(async, transaction, RBC_TIMEOUT);
+			continue;
+		}
+		section = ROBBUS_MULTI_SECTION_OVERHEAD + transaction->size;
+		if (body + section > ROBBUS_MULTI_BODY_MAX)
+			break;
+		body += section;
+		list = transaction->next;
+		transaction->next = NULL;
+		*batchTail = transaction;
+		batchTail = &transaction->next;
+	}
+	if (batch == NULL)
+		return list;
+
+	RobbusFrame_BeginMulti(&builder, frame, body);
+	for (transaction = batch; transaction != NULL; transaction = transaction->next)
+		RobbusFrame_PutSection(&builder, transaction->address, transaction->data, transaction->size);
+	ret = RobbusComm_SendFrame(async->comm, frame, RobbusFrame_End(&builder));
+
+	while (batch != NULL) {
+		transaction = batch;
+		batch = batch->next;
+		RobbusAsync_Complete(async, transaction, ret);
+	}
+	return list;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief run transaction by its own request packet
+*
+* The node replies to it even when the caller wants no reply (service
+* requests, writes too long for a multi node packet). Such reply is read
+* and dropped, otherwise the next send would take it for its echo.
+*/
+static void RobbusAsync_Run(RobbusAsync_t *async, RobbusAsync_Transaction_t *transaction) {
+	uint8_t scratch[0xff];
+	uint8_t *reply = transaction->reply != NULL ? transaction->reply : scratch;
+	uint8_t replySize = transaction->reply != NULL ? transaction->replySize : sizeof(scratch);
+	int ret = RobbusComm_SendData(async->comm, transaction->tag, transaction->address,
+		transaction->data, transaction->size);
+
+	if (ret == RBC_SUCCESS)
+		ret = RobbusComm_ReceiveData(async->comm, transaction->tag, transaction->address, reply, replySize);
+	RobbusAsync_Complete(async, transaction, ret);
+}
+
+/// bus thread
+static void *RobbusAsync_Loop(void *arg) {
+	RobbusAsync_t *async = arg;
+
+	for (;;) {
+		RobbusAsync_Transaction_t *list;
+		struct timespec now;
+
+		pthread_mutex_lock(&async->lock);
+		while (async->pending == NULL && !async->stop)
+			pthread_cond_wait(&async->submitted, &async->lock);
+		list = async->pending;
+		async->pending = NULL;
+		pthread_mutex_unlock(&async->lock);
+
+		if (list == NULL)
+			break; // stopped with nothing left
+
+		list = RobbusAsync_Sort(list);
+		while (list != NULL) {
+			RobbusAsync_Transaction_t *transaction = list;
+
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (RobbusAsync_HasDeadline(transaction) && RobbusAsync_TimeBefore(&transaction->deadline, &now)) {
+				list = transaction->next;
+				RobbusAsync_Complete(async, transaction, RBC_TIMEOUT);
+			} else if (RobbusAsync_IsWrite(transaction)) {
+				list = RobbusAsync_RunWrites(async, list);
+			} else {
+				list = transaction->next;
+				RobbusAsync_Run(async, transaction);
+			}
+		}
+	}
+	return NULL;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief start bus thread for opened bus
+*/
+RobbusAsync_t *RobbusAsync_Create(RobbusComm_t *comm) {
+	RobbusAsync_t *async = calloc(1, sizeof(RobbusAsync_t));
+	pthread_condattr_t attr;
+
+	if (async == NULL) {
+		perror("Async engine allocation failed");
+		return NULL;
+	}
+	async->comm = comm;
+	pthread_mutex_init(&async->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&async->submitted, &attr);
+	pthread_cond_init(&async->completed, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if (pthread_create(&async->thread, NULL, RobbusAsync_Loop, async) != 0) {
+		perror("Starting bus thread failed");
+		pthread_cond_destroy(&async->submitted);
+		pthread_cond_destroy(&async->completed);
+		pthread_mutex_destroy(&async->lock);
+		free(async);
+		return NULL;
+	}
+	return async;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief stop the bus thread once everything submitted is done
+*
+* Completions still in the queue are dropped, the bus stays open.
+*/
+int RobbusAsync_Destroy(RobbusAsync_t *async) {
+	pthread_mutex_lock(&async->lock);
+	async->stop = 1;
+	pthread_cond_signal(&async->submitted);
+	pthread_mutex_unlock(&async->lock);
+
+	pthread_join(async->thread, NULL);
+	pthread_cond_destroy(&async->submitted);
+	pthread_cond_destroy(&async->completed);
+	pthread_mutex_destroy(&async->lock);
+	free(async);
+	return 0;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief queue transaction for the bus thread
+*
+* \param transaction has to stay untouched until its completion
+*/
+int RobbusAsync_Submit(RobbusAsync_t *async, RobbusAsync_Transaction_t *transaction) {
+	pthread_mutex_lock(&async->lock);
+	if (async->stop) {
+		pthread_mutex_unlock(&async->lock);
+		return RBC_HANDLE;
+	}
+	transaction->next = async->pending;
+	async->pending = transaction;
+	pthread_cond_signal(&async->submitted);
+	pthread_mutex_unlock(&async->lock);
+	return RBC_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief take next completed transaction without callback
+*
+* \param deadline CLOCK_MONOTONIC time to give up waiting at, NULL to wait forever
+* \return completed transaction or NULL when the deadline passed
+*/
+RobbusAsync_Transaction_t *RobbusAsync_GetCompletion(RobbusAsync_t *async, const struct timespec *deadline) {
+	RobbusAsync_Transaction_t *transaction;
+
+	pthread_mutex_lock(&async->lock);
+	while (async->completionHead == NULL) {
+		if (deadline == NULL)
+			pthread_cond_wait(&async->completed, &async->lock);
+		else if (pthread_cond_timedwait(&async->completed, &async->lock, deadline) != 0)
+			break;
+	}
+	transaction = async->completionHead;
+	if (transaction != NULL) {
+		async->completionHead = transaction->next;
+		if (async->completionHead == NULL)
+			async->completionTail = NULL;
+		transaction->next = NULL;
+	}
+	pthread_mutex_unlock(&async->lock);
+	return transaction;
+}
@@ -0,0 +1,50 @@
+/*!
+* \file RobbusAsync.h
+* \brief queued transactions driven by a bus thread
+*
+* Transactions are submitted from any thread and completed by the thread
+* owning the bus, either by a callback or through the completion queue.
+* The bus must not be used directly while the engine runs.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#ifndef ROBBUS_ASYNC_H
+#define ROBBUS_ASYNC_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "RobbusComm.h"
+
+typedef struct RobbusAsync RobbusAsync_t;
+typedef struct RobbusAsync_Transaction RobbusAsync_Transaction_t;
+
+/// called by the bus thread when the transaction is done, must not block
+typedef void (*RobbusAsync_Callback_t)(RobbusAsync_Transaction_t *transaction);
+
+/// one request and its reply, owned by the caller until completed
+struct RobbusAsync_Transaction {
+	uint8_t		tag;
+	uint8_t		address;
+	const uint8_t	*data;		//! request payload
+	uint8_t		size;
+	uint8_t		*reply;		//! reply payload, NULL to drop it (writes may then go by multi node packet)
+	uint8_t		replySize;
+	struct timespec	deadline;	//! CLOCK_MONOTONIC time the transaction has to start by, zero for none
+	RobbusAsync_Callback_t callback; //! NULL to post the completion to the queue
+	void		*token;		//! for the caller
+	int		result;		//! RBC_ code set on completion
+	RobbusAsync_Transaction_t *next;
+};
+
+RobbusAsync_t *RobbusAsync_Create(RobbusComm_t *comm);
+int RobbusAsync_Destroy(RobbusAsync_t *async);
+int RobbusAsync_Submit(RobbusAsync_t *async, RobbusAsync_Transaction_t *transaction);
+RobbusAsync_Transaction_t *RobbusAsync_GetCompletion(RobbusAsync_t *async, const struct timespec *deadline);
+
+#endif
@@ -14,14 +14,18 @@
 
 #include <termios.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
+#include <string.h>
+#include <time.h>
 //#include <sys/stat.h>
 //#include <string.h>
 
 #include "RobbusComm.h"
 #include "SerialApi.h"
+#include "RobbusFrame.h"
 
 /* baudrate settings are defined in <asm/termbits.h>, which is
 included by <termios.h> */
@@ -32,133 +36,565 @@ included by <termios.h> */
 #define IUCLC 0
 #endif /*IUCLC*/
 
-int RobbusComm_Create(const char *deviceName) {
+#define ROBBUS_ADDRESS_COUNT 0x80
 
-	return SerialApi_Init(deviceName);
+/// turnaround estimate of a node, in the way of TCP retransmission timer
+typedef struct {
+	long		srttUs;		//! smoothed turnaround
+	long		rttvarUs;	//! its mean deviation
+	uint8_t		valid;		//! at least one reply measured
+	uint8_t		backoff;	//! replies lost in a row
+} RobbusComm_Rtt_t;
+
+struct RobbusComm {
+	SerialApi_t	*port;
+	int		echo;		//! transceiver reads back what we send (half-duplex bus)
+	unsigned long	turnaroundUs;	//! longest time the node may take to start replying
+	size_t		pendingTxBytes;	//! bytes sent without waiting for their echo, they delay the reply
+	int		stale;		//! late reply may still come, drop it before sending
+	struct timespec	waitStart;	//! when the last deadline was set
+	struct timespec	firstByte;	//! when the last decode got its first bytes, zero if none came
+	struct timespec	decodeEnd;	//! when the last decode finished
+	unsigned long long waitPendingNs; //! wire time of bytes still queued when the last deadline was set
+	RobbusComm_Rtt_t rtt[ROBBUS_ADDRESS_COUNT];
+};
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief set receive deadline for given number of bytes from now
+*
+* Wire time is computed from the baud rate (10 bits per byte), bytes
+* which are still waiting in the output queue are added.
+*
+* \param waitUs time the node takes to start the reply
+*/
+static void RobbusComm_SetDeadline(RobbusComm_t *comm, size_t bytes, unsigned long long waitUs) {
+	struct timespec deadline;
+	unsigned long long ns;
+
+	comm->waitPendingNs = comm->pendingTxBytes * 10ULL * 1000000000ULL / SerialApi_GetBaudRate(comm->port);
+	bytes += comm->pendingTxBytes;
+	comm->pendingTxBytes = 0;
+
+	ns = bytes * 10ULL * 1000000000ULL / SerialApi_GetBaudRate(comm->port) + waitUs * 1000ULL;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	comm->waitStart = deadline;
+	ns += deadline.tv_nsec;
+	deadline.tv_sec += ns / 1000000000ULL;
+	deadline.tv_nsec = ns % 1000000000ULL;
+	SerialApi_SetDeadline(comm->port, &deadline);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief set the longest time nodes may take to start their reply
+*
+* Nodes which already replied get shorter timeout derived from their
+* measured turnaround, see RobbusComm_GetReplyTimeout().
+*/
+void RobbusComm_SetTurnaround(RobbusComm_t *comm, unsigned long turnaroundUs) {
+	comm->turnaroundUs = turnaroundUs;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief time given to the node to start its reply
+*
+* \return turnaround estimate with margin, the configured turnaround until
+* the node replies for the first time
+*/
+unsigned long RobbusComm_GetReplyTimeout(RobbusComm_t *comm, uint8_t address) {
+	RobbusComm_Rtt_t *rtt = &comm->rtt[address % ROBBUS_ADDRESS_COUNT];
+	unsigned long long timeout;
+
+	if (!rtt->valid)
+		return comm->turnaroundUs;
+
+	timeout = rtt->srttUs + (4 * rtt->rttvarUs > ROBBUS_RTT_GRANULARITY_US ? 4 * rtt->rttvarUs : ROBBUS_RTT_GRANULARITY_US);
+	if (timeout < ROBBUS_RTT_MIN_TIMEOUT_US)
+		timeout = ROBBUS_RTT_MIN_TIMEOUT_US;
+	timeout <<= rtt->backoff;
+	return timeout < comm->turnaroundUs ? timeout : comm->turnaroundUs;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief update turnaround estimate of the node by the reply just received
+*
+* Turnaround is the time since the deadline was set without the wire time
+* of the queued request and of the reply (taken as if nothing was wrapped).
+*
+* \param length reply payload length
+*/
+static void RobbusComm_UpdateRtt(RobbusComm_t *comm, uint8_t address, int result, uint8_t length) {
+	RobbusComm_Rtt_t *rtt = &comm->rtt[address % ROBBUS_ADDRESS_COUNT];
+	struct timespec now = comm->decodeEnd;
+	long long sampleNs;
+	long sample, error;
+
+	if (result == RBC_TIMEOUT) {
+		comm->stale = 1;
+		if (rtt->valid && rtt->backoff < ROBBUS_RTT_MAX_BACKOFF)
+			rtt->backoff++;
+		return;
+	}
+	if (result != RBC_SUCCESS)
+		return;
+
+	sampleNs = (now.tv_sec - comm->waitStart.tv_sec) * 1000000000LL + (now.tv_nsec - comm->waitStart.tv_nsec)
+		- (long long)comm->waitPendingNs
+		- (4 + length) * 10LL * 1000000000LL / SerialApi_GetBaudRate(comm->port);
+	sample = sampleNs > 0 ? sampleNs / 1000 : 0;
+
+	rtt->backoff = 0;
+	if (!rtt->valid) {
+		rtt->srttUs = sample;
+		rtt->rttvarUs = sample / 2;
+		rtt->valid = 1;
+		return;
+	}
+	error = sample - rtt->srttUs;
+	rtt->srttUs += error / 8;
+	rtt->rttvarUs += ((error < 0 ? -error : error) - rtt->rttvarUs) / 4;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief find out whether the transceiver echoes sent bytes
+*
+* Sends a reply head of address 1, which is a special character and never
+* a node, so all nodes ignore it. Address 0 would start a multi node packet.
+*
+* \return 1 if the probe came back, 0 otherwise
+*/
+static int RobbusComm_ProbeEcho(RobbusComm_t *comm) {
+	uint8_t probe[] = {ROBBUS_TAG_REGULAR, ROBBUS_ADDRESS_REPLY_MASK | 0x01};
+	uint8_t echo[sizeof(probe)];
+
+	SerialApi_Flush(comm->port);
+	if (SerialApi_Send(comm->port, probe, sizeof(probe)) != 0)
+		return 1; // keep the safe default
+	RobbusComm_SetDeadline(comm, sizeof(probe), comm->turnaroundUs);
+
+	return SerialApi_Receive(comm->port, echo, sizeof(echo)) > 0;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief open bus on given device
+*
+* \param deviceName serial port the bus is connected to
+* \param baudRate bus speed
+* \return bus context or NULL on failure
+*/
+RobbusComm_t *RobbusComm_Open(const char *deviceName, unsigned long baudRate) {
+	RobbusComm_t *comm;
+
+	if (baudRate == 0)
+		return NULL;
+
+	comm = calloc(1, sizeof(RobbusComm_t));
+	if (comm == NULL)
+		return NULL;
+
+	comm->port = SerialApi_Open(deviceName, baudRate);
+	if (comm->port == NULL) {
+		free(comm);
+		return NULL;
+	}
+	comm->turnaroundUs = ROBBUS_DEFAULT_TURNAROUND_US;
+	comm->pendingTxBytes = 0;
+
+	comm->echo = RobbusComm_ProbeEcho(comm);
+	printf("Bus %s echo %s\n", deviceName, comm->echo ? "detected" : "not detected, echo check disabled");
+	return comm;
 }
 
 ///////////////////////////////////////////////////////////
 /*!
 * Destructor
 */
-int RobbusComm_Close(void) {
-	return SerialApi_Close();
+int RobbusComm_Close(RobbusComm_t *comm) {
+	int ret = SerialApi_Close(comm->port);
+	free(comm);
+	return ret;
 }
 
 ///////////////////////////////////////////////////////////
 /*!
-* \brief send single byte
+* \brief send already built frame
 *
-* \param a_toSend byte to send
+* \param frame frame composed by RobbusFrame_Build()
+* \param length frame length
 */
-int RobbusComm_SendByte(uint8_t c, uint8_t *checkSum)
-{
-	SerialApi_SendByte(c);
-	SerialApi_ReceiveByte(); // TODO: consume sent byte
+int RobbusComm_SendFrame(RobbusComm_t *comm, const uint8_t *frame, size_t length) {
+	uint8_t echo[ROBBUS_FRAME_MAX_SIZE];
 
-	if (checkSum != NULL)
-		*checkSum += c;
+	if (comm->stale) {
+		// reply which came after its timeout would be taken for the next one
+		SerialApi_Flush(comm->port);
+		comm->stale = 0;
+	}
+	if (SerialApi_Send(comm->port, frame, length) != 0)
+		return RBC_HANDLE;
+
+	if (!comm->echo) {
+		comm->pendingTxBytes += length;
+		return RBC_SUCCESS;
+	}
+	RobbusComm_SetDeadline(comm, length, comm->turnaroundUs);
+
+	// consume sent bytes, anything else means someone else was talking
+	if (SerialApi_Receive(comm->port, echo, length) != length || memcmp(echo, frame, length) != 0)
+		return RBC_COLLISION;
 
 	return RBC_SUCCESS;
 }
 
-int RobbusComm_SendByteWrapped(uint8_t c, uint8_t *checkSum)
-{
-	if (c < 4) {
-		RobbusComm_SendByte(0, NULL);
-		RobbusComm_SendByte(c+4, NULL);
-	} else {
-		RobbusComm_SendByte(c, NULL);
+int RobbusComm_SendData(RobbusComm_t *comm, uint8_t tag, uint8_t address, const uint8_t* data, uint8_t size) {
+	uint8_t frame[ROBBUS_FRAME_MAX_SIZE];
+
+	return RobbusComm_SendFrame(comm, frame, RobbusFrame_Build(frame, tag, address, data, size));
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief send payload to all nodes matching address and mask
+*
+* Nodes do not reply to group packets.
+*/
+int RobbusComm_SendGroupData(RobbusComm_t *comm, uint8_t address, uint8_t mask, const uint8_t* data, uint8_t size) {
+	uint8_t frame[ROBBUS_FRAME_MAX_SIZE];
+
+	return RobbusComm_SendFrame(comm, frame, RobbusFrame_BuildGroup(frame, address, mask, data, size));
+}
+
+/// worst case reply length: every byte of length, payload and checksum wrapped
+#define RobbusComm_ReplyBytes(size) (2 + 2 * (1 + (size) + 1))
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief decode one frame from received bytes until the deadline
+*/
+static int RobbusComm_Decode(RobbusComm_t *comm, RobbusFrame_Decoder_t *decoder) {
+	int ret;
+
+	comm->firstByte.tv_sec = 0;
+	comm->firstByte.tv_nsec = 0;
+	do {
+		const uint8_t *chunk;
+		size_t available, consumed;
+
+		available = SerialApi_ReceiveChunk(comm->port, &chunk);
+		if (available == 0) {
+			ret = RBC_TIMEOUT;
+			break;
+		}
+		if (comm->firstByte.tv_sec == 0 && comm->firstByte.tv_nsec == 0)
+			clock_gettime(CLOCK_MONOTONIC, &comm->firstByte);
+
+		ret = RobbusFrame_Decode(decoder, chunk, available, &consumed);
+		SerialApi_Consume(comm->port, consumed);
+	} while (ret == RBC_PENDING);
+
+	clock_gettime(CLOCK_MONOTONIC, &comm->decodeEnd);
+	return ret;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief time from the last request to the first byte of its reply
+*
+* \return time in us, 0 if nothing came
+*/
+unsigned long RobbusComm_GetFirstByteLatency(RobbusComm_t *comm) {
+	long long ns;
+
+	if (comm->firstByte.tv_sec == 0 && comm->firstByte.tv_nsec == 0)
+		return 0;
+	ns = (comm->firstByte.tv_sec - comm->waitStart.tv_sec) * 1000000000LL
+		+ (comm->firstByte.tv_nsec - comm->waitStart.tv_nsec);
+	return ns > 0 ? ns / 1000 : 0;
+}
+
+int RobbusComm_ReceiveData(RobbusComm_t *comm, uint8_t tag, uint8_t address, uint8_t* data, uint8_t size) {
+	RobbusFrame_Decoder_t decoder;
+	int ret;
+
+	RobbusComm_SetDeadline(comm, RobbusComm_ReplyBytes(size), RobbusComm_GetReplyTimeout(comm, address));
+
+	RobbusFrame_DecoderInit(&decoder, tag, address, data, size);
+	ret = RobbusComm_Decode(comm, &decoder);
+	RobbusComm_UpdateRtt(comm, address, ret, decoder.length);
+
+	return ret;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief check the node answers by the shortest packet, it changes nothing in the node
+*/
+int RobbusComm_Echo(RobbusComm_t *comm, uint8_t address) {
+	uint8_t request = ROBBUS_SUBPACKET_ECHO, reply;
+	int ret = RobbusComm_SendData(comm, ROBBUS_TAG_SERVICE, address, &request, 1);
+
+	if (ret == RBC_SUCCESS)
+		ret = RobbusComm_ReceiveData(comm, ROBBUS_TAG_SERVICE, address, &reply, 1);
+	if (ret == RBC_SUCCESS && reply != ROBBUS_SUBPACKET_ECHO)
+		ret = RBC_TAG;
+	return ret;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief slot width fitting a whole reply of given size
+*
+* \return width in ROBBUS_GROUP_READ_SLOT_UNIT_US, 0 if the reply does not fit the widest slot
+*/
+uint8_t RobbusComm_GetSlotWidth(RobbusComm_t *comm, uint8_t replySize) {
+	unsigned long long us = RobbusComm_ReplyBytes(replySize) * 10ULL * 1000000ULL / SerialApi_GetBaudRate(comm->port)
+		+ ROBBUS_GROUP_READ_GUARD_US;
+	unsigned long long width = (us + ROBBUS_GROUP_READ_SLOT_UNIT_US - 1) / ROBBUS_GROUP_READ_SLOT_UNIT_US;
+
+	return width > 0xff ? 0 : width;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief send group read packet and wait for replies of all its slots
+*
+* Replies are picked one by one by RobbusComm_ReceiveGroupReply(), all of
+* them have to come before the end of the last slot.
+*
+* \param slotWidth slot width from RobbusComm_GetSlotWidth()
+* \param slots number of slots the replies may come in
+* \param replySize longest reply expected
+*/
+int RobbusComm_SendGroupRead(RobbusComm_t *comm, uint8_t address, uint8_t mask, uint8_t slotWidth,
+	int slots, uint8_t replySize, const uint8_t* data, uint8_t size) {
+	uint8_t frame[ROBBUS_FRAME_MAX_SIZE];
+	int ret;
+
+	if (size == 0xff)
+		return RBC_LENGTH; // no space for the slot width
+
+	ret = RobbusComm_SendFrame(comm, frame, RobbusFrame_BuildGroupRead(frame, address, mask, slotWidth, data, size));
+	if (ret == RBC_SUCCESS) {
+		RobbusComm_SetDeadline(comm, RobbusComm_ReplyBytes(replySize),
+			comm->turnaroundUs + (slots - 1) * (unsigned long long)slotWidth * ROBBUS_GROUP_READ_SLOT_UNIT_US);
 	}
-	
-	if (checkSum != NULL)
-		*checkSum += c;
+	return ret;
+}
 
-	return RBC_SUCCESS;
+///////////////////////////////////////////////////////////
+/*!
+* \brief receive next reply to group read packet
+*
+* \param address set to the replying node
+* \param size capacity of data, set to the payload length received
+* \return RBC_TIMEOUT when the last slot is over
+*/
+int RobbusComm_ReceiveGroupReply(RobbusComm_t *comm, uint8_t *address, uint8_t* data, uint8_t *size) {
+	RobbusFrame_Decoder_t decoder;
+	int ret;
+
+	RobbusFrame_DecoderInit(&decoder, ROBBUS_TAG_REGULAR, ROBBUS_FRAME_ANY_ADDRESS, data, *size);
+	ret = RobbusComm_Decode(comm, &decoder);
+	*address = decoder.address;
+	*size = decoder.length;
+	return ret;
 }
 
-int RobbusComm_ReceiveByte(void)
-{
-  return SerialApi_ReceiveByte();
- 
+void RobbusComm_ChangeStateInit(RobbusComm_ChangeState_t *state) {
+	memset(state, 0, sizeof(RobbusComm_ChangeState_t));
+	state->inSequence = 1;
 }
 
-int RobbusComm_ReceiveByteWrapped(void) {
-	int c = RobbusComm_ReceiveByte();
-	if (c < 0) return c;
-	if (c >= 4) return c;
+///////////////////////////////////////////////////////////
+/*!
+* \brief send input by change only packet
+*
+* Input equal to the one the node has already goes as sequence number only.
+*
+* \param state state of the node, initialized by RobbusComm_ChangeStateInit()
+*/
+int RobbusComm_SendChanged(RobbusComm_t *comm, RobbusComm_ChangeState_t *state, uint8_t address, const uint8_t* data, uint8_t size) {
+	uint8_t payload[255];
+	uint8_t length = ROBBUS_CHANGED_HEADER_SIZE;
 
-	c = RobbusComm_ReceiveByte();
-	if (c < 0) return c;
-	return c - 4;
+	if (size > ROBBUS_CHANGED_DATA_MAX)
+		return RBC_LENGTH;
+
+	if (!state->inKnown || state->inSize != size || memcmp(state->lastIn, data, size) != 0) {
+		if (++state->inSequence == 0)
+			state->inSequence = 1;
+		memcpy(state->lastIn, data, size);
+		state->inSize = size;
+		state->inKnown = 0; // until the node confirms it
+		memcpy(payload + length, data, size);
+		length += size;
+	}
+	payload[0] = ROBBUS_SUBPACKET_CHANGED;
+	payload[1] = state->inSequence;
+	payload[2] = state->outSequence;
+
+	return RobbusComm_SendData(comm, ROBBUS_TAG_SERVICE, address, payload, length);
 }
 
-int RobbusComm_SendData(uint8_t tag, uint8_t address, const uint8_t* data, uint8_t size) {
-	uint8_t i, checkSum = 0;
-	
-	//printf("Sending %d byte(s) to node %d with tag %d: ", size, address, tag);
-	//for (i = 0; i < size; i++)
-	//	printf("%02x", data[i]);
-	//printf("\n");
+///////////////////////////////////////////////////////////
+/*!
+* \brief receive reply to change only packet
+*
+* \param data set to the node output, changed or not
+* \param size output size of the node
+* \return RBC_RESYNC when the node asked for the input again
+*/
+int RobbusComm_ReceiveChanged(RobbusComm_t *comm, RobbusComm_ChangeState_t *state, uint8_t address, uint8_t* data, uint8_t size) {
+	RobbusFrame_Decoder_t decoder;
+	uint8_t reply[255];
+	int ret;
+
+	if (size > sizeof(reply) - 1)
+		return RBC_LENGTH;
 
-	// TODO: flush serial buffer
-	RobbusComm_SendByte(tag, NULL);
-	RobbusComm_SendByte(address, &checkSum);
-	RobbusComm_SendByteWrapped(size, &checkSum);
-	
-	// data
-	for (i = 0; i < size; i++) {
-		RobbusComm_SendByteWrapped(data[i], &checkSum);
+	RobbusComm_SetDeadline(comm, RobbusComm_ReplyBytes(1 + size), RobbusComm_GetReplyTimeout(comm, address));
+
+	RobbusFrame_DecoderInit(&decoder, ROBBUS_TAG_SERVICE, address, reply, 1 + size);
+	ret = RobbusComm_Decode(comm, &decoder);
+	RobbusComm_UpdateRtt(comm, address, ret, decoder.length);
+	if (ret != RBC_SUCCESS) {
+		state->inKnown = 0; // not sure whether the node has got the input
+		return ret;
 	}
-	RobbusComm_SendByteWrapped((~checkSum)+1, NULL);
 
+	if (decoder.length == 0) {
+		state->inKnown = 0;
+		state->outSequence = 0;
+		return RBC_RESYNC;
+	}
+	if (decoder.length == 1 + size) {
+		memcpy(state->lastOut, reply + 1, size);
+	} else if (decoder.length != 1 || reply[0] != state->outSequence || state->outSequence == 0) {
+		state->outSequence = 0;
+		return RBC_LENGTH;
+	}
+	state->outSequence = reply[0];
+	state->inKnown = 1;
+	memcpy(data, state->lastOut, size);
 	return RBC_SUCCESS;
 }
 
+/// service request with reply of at most size bytes
+static int RobbusComm_BulkRequest(RobbusComm_t *comm, uint8_t address, const uint8_t *request, uint8_t requestSize,
+	uint8_t *reply, uint8_t size, uint8_t *length) {
+	RobbusFrame_Decoder_t decoder;
+	int ret = RobbusComm_SendData(comm, ROBBUS_TAG_SERVICE, address, request, requestSize);
 
-int RobbusComm_ReceiveData(uint8_t tag, uint8_t address, uint8_t* data, uint8_t size) {
-	int c;
-	uint8_t i, packetSize, checkSum = 0;
+	if (ret != RBC_SUCCESS)
+		return ret;
+	RobbusComm_SetDeadline(comm, RobbusComm_ReplyBytes(size), RobbusComm_GetReplyTimeout(comm, address));
 
-	// tag
-	c = RobbusComm_ReceiveByte();	
-	if (c < 0) return c;
-	if (c != tag) {
-		// printf("Got tag %d instead of %d\n", c, tag);
-		return RBC_TAG;
-	}
-	
-	// address TODO: manage group
-	c = RobbusComm_ReceiveByte();	
-	if (c < 0) return c;
-	if (((c&0x80) == 0) || ((c^0x80) != address)) return RBC_ADDRESS;
-	checkSum += (uint8_t)c;
-	
-	// length
-	c = RobbusComm_ReceiveByteWrapped();	
-	if (c < 0) return c;
-	packetSize = (uint8_t)c;
-	checkSum += packetSize;
-
-	for (i = 0; i < packetSize; i++) {
-		c = RobbusComm_ReceiveByteWrapped();	
-		if (c < 0) return c;
-		data[i] = (uint8_t)c;
-		checkSum += (uint8_t)c;
+	RobbusFrame_DecoderInit(&decoder, ROBBUS_TAG_SERVICE, address, reply, size);
+	ret = RobbusComm_Decode(comm, &decoder);
+	RobbusComm_UpdateRtt(comm, address, ret, decoder.length);
+	*length = decoder.length;
+	return ret;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief write data longer than one packet to the node bulk buffer
+*
+* Blocks of the window go back to back, then one acknowledgement tells
+* which of them arrived; only the missing ones are sent again.
+*
+* \param size up to 65535 bytes, limited by the node buffer
+* \return RBC_LENGTH when the node refused the transfer,
+* RBC_TIMEOUT when it stopped making progress
+*/
+int RobbusComm_BulkWrite(RobbusComm_t *comm, uint8_t address, const uint8_t* data, size_t size) {
+	uint8_t payload[255], reply[3], length;
+	unsigned blockSize, blocks, base = 0, received = 0, i;
+	int retries = 0, ret;
+
+	if (size > 0xffff)
+		return RBC_LENGTH;
+
+	payload[0] = ROBBUS_SUBPACKET_BULK_BEGIN;
+	payload[1] = size;
+	payload[2] = size >> 8;
+	payload[3] = ROBBUS_BULK_BLOCK_MAX;
+	ret = RobbusComm_BulkRequest(comm, address, payload, 4, reply, sizeof(reply), &length);
+	if (ret != RBC_SUCCESS)
+		return ret;
+	// block size comes from the node, larger one would not fit the payload
+	if (length != 3 || reply[0] == 0 || reply[0] > ROBBUS_BULK_BLOCK_MAX)
+		return RBC_LENGTH;
+	blockSize = reply[0];
+	blocks = (size + blockSize - 1) / blockSize;
+
+	while (base < blocks) {
+		for (i = 0; i < ROBBUS_BULK_WINDOW && base + i < blocks; i++) {
+			size_t offset = (size_t)(base + i) * blockSize;
+			uint8_t blockLength = size - offset < blockSize ? size - offset : blockSize;
+
+			if (received & (1 << i))
+				continue;
+			payload[0] = ROBBUS_SUBPACKET_BULK_WRITE;
+			payload[1] = base + i;
+			payload[2] = (base + i) >> 8;
+			memcpy(payload + ROBBUS_BULK_HEADER_SIZE, data + offset, blockLength);
+			ret = RobbusComm_SendData(comm, ROBBUS_TAG_SERVICE, address, payload, ROBBUS_BULK_HEADER_SIZE + blockLength);
+			if (ret != RBC_SUCCESS)
+				return ret;
+		}
+
+		payload[0] = ROBBUS_SUBPACKET_BULK_ACK;
+		ret = RobbusComm_BulkRequest(comm, address, payload, 1, reply, sizeof(reply), &length);
+		if (ret == RBC_SUCCESS && length == 3) {
+			unsigned next = reply[0] | (reply[1] << 8);
+			if (next < base || next > blocks)
+				return RBC_RESYNC; // node started over
+			if (next != base || reply[2] != received) {
+				retries = 0;
+				base = next;
+				received = reply[2];
+				continue;
+			}
+		}
+		if (++retries >= ROBBUS_BULK_RETRIES)
+			return ret != RBC_SUCCESS ? ret : RBC_TIMEOUT;
 	}
-	
-	// checksum
-	c = RobbusComm_ReceiveByteWrapped();	
-	if (c < 0) return c;
-	checkSum += (uint8_t)c;
-
-	if (checkSum != 0) return RBC_CHECKSUM;
-	
-	//printf("Received %d byte(s) from node %d with tag %d: ", size, address, tag);
-	//for (c = 0; c < size; c++)
-	//	printf("%02x", data[c]);
-	//printf("\n");
-	
-return RBC_SUCCESS;
+	return RBC_SUCCESS;
+}
 
+///////////////////////////////////////////////////////////
+/*!
+* \brief read the node bulk buffer
+*
+* \return RBC_LENGTH when the buffer ends before offset + size
+*/
+int RobbusComm_BulkRead(RobbusComm_t *comm, uint8_t address, uint16_t offset, uint8_t* data, size_t size) {
+	uint8_t request[4], length;
+	size_t done = 0;
+	int ret;
+
+	while (done < size) {
+		size_t position = offset + done;
+		uint8_t chunk = size - done < 0xff ? size - done : 0xff;
+
+		if (position > 0xffff)
+			return RBC_LENGTH;
+		request[0] = ROBBUS_SUBPACKET_BULK_READ;
+		request[1] = position;
+		request[2] = position >> 8;
+		request[3] = chunk;
+		ret = RobbusComm_BulkRequest(comm, address, request, sizeof(request), data + done, chunk, &length);
+		if (ret != RBC_SUCCESS)
+			return ret;
+		if (length == 0)
+			return RBC_LENGTH;
+		done += length;
+	}
+	return RBC_SUCCESS;
 }
@@ -16,11 +16,26 @@
 #include <stdlib.h>
 
 #define ROBBUS_DEFAULT_DEVICE "/dev/robbus"
+#define ROBBUS_DEFAULT_BAUDRATE 115200UL
 #define ROBBUS_TAG_SERVICE 1
 #define ROBBUS_TAG_REGULAR 2
 #define ROBBUS_TAG_GROUP 3
 
+/// default time for the node to start the reply (on top of the wire time)
+#define ROBBUS_DEFAULT_TURNAROUND_US 10000UL
+
+/// reply timeout of nodes with measured turnaround: smoothed turnaround plus
+/// four mean deviations (at least the granularity), not below the minimum
+#define ROBBUS_RTT_MIN_TIMEOUT_US 1000UL
+#define ROBBUS_RTT_GRANULARITY_US 250UL
+/// timeout doubles after each lost reply up to this many times
+#define ROBBUS_RTT_MAX_BACKOFF 6
+
+/// time added to each group read slot for the node to start its reply
+#define ROBBUS_GROUP_READ_GUARD_US 200UL
+
 // error codes
+#define RBC_PENDING 1 // frame not complete yet (decoder only)
 #define RBC_SUCCESS 0
 #define RBC_TIMEOUT -1
 #define RBC_TAG -2
@@ -28,9 +43,59 @@
 #define RBC_LENGTH -4
 #define RBC_CHECKSUM -5
 #define RBC_HANDLE -6
+#define RBC_COLLISION -7
+#define RBC_RESYNC -8 // node lost the last input of change only packets, full data go next time
+
+/// service subpacket the node returns as it is, for checking it is there
+#define ROBBUS_SUBPACKET_ECHO 'e'
+
+/// service subpacket carrying input and output only when they changed
+#define ROBBUS_SUBPACKET_CHANGED 'c'
+#define ROBBUS_CHANGED_HEADER_SIZE 3
+/// longest input of change only packet
+#define ROBBUS_CHANGED_DATA_MAX (255 - ROBBUS_CHANGED_HEADER_SIZE)
+
+/// service subpackets of bulk transfer into the node bulk buffer
+#define ROBBUS_SUBPACKET_BULK_BEGIN 'B'
+#define ROBBUS_SUBPACKET_BULK_WRITE 'W'
+#define ROBBUS_SUBPACKET_BULK_ACK 'K'
+#define ROBBUS_SUBPACKET_BULK_READ 'R'
+#define ROBBUS_BULK_HEADER_SIZE 3
+#define ROBBUS_BULK_BLOCK_MAX (255 - ROBBUS_BULK_HEADER_SIZE)
+/// blocks sent before asking for acknowledgement
+#define ROBBUS_BULK_WINDOW 8
+/// acknowledgements in a row without progress before bulk transfer gives up
+#define ROBBUS_BULK_RETRIES 5
+
+typedef struct RobbusComm RobbusComm_t;
+
+/// what the host and a node know about each other for change only packets
+typedef struct {
+	uint8_t	inSequence;	//! sequence of lastIn, never 0
+	uint8_t	inKnown;	//! node has lastIn
+	uint8_t	inSize;
+	uint8_t	outSequence;	//! sequence of lastOut, 0 when unknown
+	uint8_t	lastIn[ROBBUS_CHANGED_DATA_MAX];
+	uint8_t	lastOut[254];
+} RobbusComm_ChangeState_t;
 
-int RobbusComm_Create(const char *deviceName);
-int RobbusComm_Close(void);
-int RobbusComm_SendData(uint8_t tag, uint8_t address, const uint8_t* data, uint8_t size);
-int RobbusComm_ReceiveData(uint8_t tag, uint8_t address, uint8_t* data, uint8_t size);
+RobbusComm_t *RobbusComm_Open(const char *deviceName, unsigned long baudRate);
+int RobbusComm_Close(RobbusComm_t *comm);
+void RobbusComm_SetTurnaround(RobbusComm_t *comm, unsigned long turnaroundUs);
+unsigned long RobbusComm_GetReplyTimeout(RobbusComm_t *comm, uint8_t address);
+unsigned long RobbusComm_GetFirstByteLatency(RobbusComm_t *comm);
+int RobbusComm_SendFrame(RobbusComm_t *comm, const uint8_t *frame, size_t length);
+int RobbusComm_SendGroupData(RobbusComm_t *comm, uint8_t address, uint8_t mask, const uint8_t* data, uint8_t size);
+int RobbusComm_SendData(RobbusComm_t *comm, uint8_t tag, uint8_t address, const uint8_t* data, uint8_t size);
+int RobbusComm_ReceiveData(RobbusComm_t *comm, uint8_t tag, uint8_t address, uint8_t* data, uint8_t size);
+int RobbusComm_Echo(RobbusComm_t *comm, uint8_t address);
+uint8_t RobbusComm_GetSlotWidth(RobbusComm_t *comm, uint8_t replySize);
+int RobbusComm_SendGroupRead(RobbusComm_t *comm, uint8_t address, uint8_t mask, uint8_t slotWidth,
+	int slots, uint8_t replySize, const uint8_t* data, uint8_t size);
+int RobbusComm_ReceiveGroupReply(RobbusComm_t *comm, uint8_t *address, uint8_t* data, uint8_t *size);
+void RobbusComm_ChangeStateInit(RobbusComm_ChangeState_t *state);
+int RobbusComm_SendChanged(RobbusComm_t *comm, RobbusComm_ChangeState_t *state, uint8_t address, const uint8_t* data, uint8_t size);
+int RobbusComm_ReceiveChanged(RobbusComm_t *comm, RobbusComm_ChangeState_t *state, uint8_t address, uint8_t* data, uint8_t size);
+int RobbusComm_BulkWrite(RobbusComm_t *comm, uint8_t address, const uint8_t* data, size_t size);
+int RobbusComm_BulkRead(RobbusComm_t *comm, uint8_t address, uint16_t offset, uint8_t* data, size_t size);
 #endif
@@ -0,0 +1,209 @@
+/*!
+* \file RobbusCommand.c
+* \brief priority commands for robbus_sync in a shared memory segment
+*
+* Rings are bounded queues with a sequence in each cell (Vyukov): a
+* producer claims position by moving the head, fills the cell and then
+* publishes it by its sequence, so the bus thread never takes half of it.
+* Producer dying between the two stops the ring until robbus_sync restarts.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "RobbusCommand.h"
+#include "RobbusComm.h"
+#include "RobbusShm.h"
+
+#define RING_MASK (ROBBUS_COMMAND_RING_SIZE - 1)
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief create command segment with empty rings, by robbus_sync
+*
+* \return segment or NULL on failure
+*/
+RobbusCommand_Queue_t *RobbusCommand_Create(int busCount) {
+	RobbusCommand_Queue_t *queue = RobbusShm_CreateSegment(ROBBUS_SHM_COMMAND, sizeof(RobbusCommand_Queue_t));
+	int i, j;
+
+	if (queue == NULL)
+		return NULL;
+	queue->busCount = busCount < ROBBUS_COMMAND_MAX_BUSES ? busCount : ROBBUS_COMMAND_MAX_BUSES;
+	for (i = 0; i < ROBBUS_COMMAND_MAX_BUSES; i++) {
+		for (j = 0; j < ROBBUS_COMMAND_RING_SIZE; j++)
+			queue->rings[i].cells[j].sequence = j;
+	}
+	__atomic_store_n(&queue->magic, ROBBUS_COMMAND_MAGIC, __ATOMIC_RELEASE);
+	return queue;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief attach command segment of a running robbus_sync
+*
+* \return segment or NULL if there is none
+*/
+RobbusCommand_Queue_t *RobbusCommand_Attach(void) {
+	RobbusCommand_Queue_t *queue = RobbusShm_Attach(ROBBUS_SHM_COMMAND);
+
+	if (queue == NULL || __atomic_load_n(&queue->magic, __ATOMIC_ACQUIRE) != ROBBUS_COMMAND_MAGIC)
+		return NULL;
+	return queue;
+}
+
+/// ring of a bus, NULL for buses beyond ROBBUS_COMMAND_MAX_BUSES
+RobbusCommand_Ring_t *RobbusCommand_GetRing(RobbusCommand_Queue_t *queue, int bus) {
+	if (bus < 0 || bus >= queue->busCount)
+		return NULL;
+	return &queue->rings[bus];
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief queue command for a node and wake the bus thread
+*
+* Needs the control segment of robbus_sync (attached on first use).
+*
+* \param bus index of the bus syncing the node, see RobbusShm_LayoutNode_t
+* \return completion slot for RobbusCommand_Wait(), RBC_HANDLE when the bus
+*	has no ring, RBC_COLLISION when the ring or the completion slots are full
+*/
+int RobbusCommand_Submit(RobbusCommand_Queue_t *queue, int bus, uint8_t address, const uint8_t *data, uint8_t size) {
+	RobbusCommand_Ring_t *ring = RobbusCommand_GetRing(queue, bus);
+	RobbusCommand_t *cell;
+	uint32_t position, expected;
+	int completion;
+
+	if (ring == NULL)
+		return RBC_HANDLE;
+	for (completion = 0; completion < ROBBUS_COMMAND_COMPLETIONS; completion++) {
+		expected = ROBBUS_COMMAND_FREE;
+		if (__atomic_compare_exchange_n(&queue->completions[completion].state, &expected,
+			ROBBUS_COMMAND_PENDING, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+	}
+	if (completion == ROBBUS_COMMAND_COMPLETIONS)
+		return RBC_COLLISION;
+
+	position = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	for (;;) {
+		int32_t diff;
+		cell = &ring->cells[position & RING_MASK];
+		diff = (int32_t)(__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - position);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&ring->head, &position, position + 1, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			// not taken by the bus thread yet
+			__atomic_store_n(&queue->completions[completion].state, ROBBUS_COMMAND_FREE, __ATOMIC_RELEASE);
+			return RBC_COLLISION;
+		} else {
+			position = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	cell->completion = completion;
+	cell->address = address;
+	cell->size = size;
+	memcpy(cell->data, data, size);
+	__atomic_store_n(&cell->sequence, position + 1, __ATOMIC_RELEASE);
+	RobbusShm_NotifyInput();
+	return completion;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief wait for result of submitted command and release its completion slot
+*
+* \param reply room for ROBBUS_COMMAND_DATA_SIZE bytes, NULL if not needed
+* \param deadlineUs CLOCK_MONOTONIC time in us to give up at
+* \return RBC_ code of the transaction, RBC_TIMEOUT also when the deadline passed
+*/
+int RobbusCommand_Wait(RobbusCommand_Queue_t *queue, int completion, uint8_t *reply, uint8_t *replySize,
+	unsigned long long deadlineUs) {
+	RobbusCommand_Completion_t *slot = &queue->completions[completion];
+	struct timespec deadline;
+	uint32_t state = ROBBUS_COMMAND_PENDING;
+	int result;
+
+	deadline.tv_sec = deadlineUs / 1000000ULL;
+	deadline.tv_nsec = (deadlineUs % 1000000ULL) * 1000;
+	while (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) == ROBBUS_COMMAND_PENDING) {
+		if (syscall(SYS_futex, &slot->state, FUTEX_WAIT_BITSET, ROBBUS_COMMAND_PENDING,
+			&deadline, NULL, FUTEX_BITSET_MATCH_ANY) == -1 && errno == ETIMEDOUT) {
+			// bus thread frees it when it is done
+			if (__atomic_compare_exchange_n(&slot->state, &state, ROBBUS_COMMAND_ABANDONED, 0,
+				__ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+				return RBC_TIMEOUT;
+			break; // completed meanwhile
+		}
+	}
+
+	result = slot->result;
+	if (replySize != NULL)
+		*replySize = slot->replySize;
+	if (reply != NULL)
+		memcpy(reply, slot->reply, slot->replySize);
+	__atomic_store_n(&slot->state, ROBBUS_COMMAND_FREE, __ATOMIC_RELEASE);
+	return result;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief take next command of the bus, by its thread only
+*
+* \return 1 if a command was taken, 0 if the ring is empty
+*/
+int RobbusCommand_Take(RobbusCommand_Ring_t *ring, RobbusCommand_t *command) {
+	uint32_t position = ring->tail;
+	RobbusCommand_t *cell = &ring->cells[position & RING_MASK];
+
+	if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != position + 1)
+		return 0;
+	command->completion = cell->completion;
+	command->address = cell->address;
+	command->size = cell->size;
+	memcpy(command->data, cell->data, cell->size);
+	// free the cell for the producers of the next lap
+	__atomic_store_n(&cell->sequence, position + ROBBUS_COMMAND_RING_SIZE, __ATOMIC_RELEASE);
+	ring->tail = position + 1;
+	return 1;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief hand result of a command to its submitter
+*/
+void RobbusCommand_Complete(RobbusCommand_Queue_t *queue, uint32_t completion, int result,
+	const uint8_t *reply, uint8_t replySize) {
+	RobbusCommand_Completion_t *slot;
+	uint32_t state = ROBBUS_COMMAND_PENDING;
+
+	if (completion >= ROBBUS_COMMAND_COMPLETIONS)
+		return;
+	slot = &queue->completions[completion];
+	slot->result = result;
+	slot->replySize = replySize;
+	memcpy(slot->reply, reply, replySize);
+	if (!__atomic_compare_exchange_n(&slot->state, &state, ROBBUS_COMMAND_DONE, 0,
+		__ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&slot->state, ROBBUS_COMMAND_FREE, __ATOMIC_RELEASE); // abandoned
+		return;
+	}
+	syscall(SYS_futex, &slot->state, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
@@ -0,0 +1,80 @@
+/*!
+* \file RobbusCommand.h
+* \brief priority commands for robbus_sync in a shared memory segment
+*
+* Any process may put a command into the ring of a bus, the bus thread of
+* robbus_sync sends it before its next transaction and puts the reply into
+* the completion slot the command came with. The command does not change
+* the input memory, write it as well so the next round does not send the
+* old data again.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#ifndef ROBBUS_COMMAND_H
+#define ROBBUS_COMMAND_H
+
+#include <stdint.h>
+
+#define ROBBUS_COMMAND_MAGIC 0x44434252UL	// "RBCD"
+/// buses with a ring, further ones take no commands
+#define ROBBUS_COMMAND_MAX_BUSES 8
+/// commands queued per bus, power of two
+#define ROBBUS_COMMAND_RING_SIZE 16
+#define ROBBUS_COMMAND_COMPLETIONS 32
+#define ROBBUS_COMMAND_DATA_SIZE 0xff
+
+/// completion slot states
+#define ROBBUS_COMMAND_FREE	0
+#define ROBBUS_COMMAND_PENDING	1	//! command queued or on the wire
+#define ROBBUS_COMMAND_DONE	2	//! result and reply filled
+#define ROBBUS_COMMAND_ABANDONED 3	//! submitter gave up waiting, freed on completion
+
+typedef struct {
+	uint32_t	sequence;	//! position the cell is free or filled for
+	uint32_t	completion;	//! completion slot index
+	uint8_t		address;
+	uint8_t		size;
+	uint8_t		data[ROBBUS_COMMAND_DATA_SIZE];
+} RobbusCommand_t;
+
+/// bounded queue with many producers and the bus thread as the only consumer
+typedef struct {
+	uint32_t	head;		//! next position to fill, producers move it
+	uint32_t	tail;		//! next position to take, bus thread only
+	RobbusCommand_t	cells[ROBBUS_COMMAND_RING_SIZE];
+} RobbusCommand_Ring_t;
+
+typedef struct {
+	uint32_t	state;		//! futex word
+	int32_t		result;		//! RBC_ code
+	uint8_t		replySize;
+	uint8_t		reply[ROBBUS_COMMAND_DATA_SIZE];
+} RobbusCommand_Completion_t;
+
+typedef struct {
+	uint32_t	magic;
+	uint32_t	busCount;
+	RobbusCommand_Ring_t rings[ROBBUS_COMMAND_MAX_BUSES];
+	RobbusCommand_Completion_t completions[ROBBUS_COMMAND_COMPLETIONS];
+} RobbusCommand_Queue_t;
+
+RobbusCommand_Queue_t *RobbusCommand_Create(int busCount);
+RobbusCommand_Queue_t *RobbusCommand_Attach(void);
+RobbusCommand_Ring_t *RobbusCommand_GetRing(RobbusCommand_Queue_t *queue, int bus);
+
+// submitting process
+int RobbusCommand_Submit(RobbusCommand_Queue_t *queue, int bus, uint8_t address, const uint8_t *data, uint8_t size);
+int RobbusCommand_Wait(RobbusCommand_Queue_t *queue, int completion, uint8_t *reply, uint8_t *replySize,
+	unsigned long long deadlineUs);
+
+// bus thread
+int RobbusCommand_Take(RobbusCommand_Ring_t *ring, RobbusCommand_t *command);
+void RobbusCommand_Complete(RobbusCommand_Queue_t *queue, uint32_t completion, int result,
+	const uint8_t *reply, uint8_t replySize);
+
+#endif
@@ -0,0 +1,361 @@
+/*!
+* \file RobbusFrame.c
+* \brief building and decoding of robbus frames in memory
+*
+* The whole frame (including wrapped special characters) is composed
+* in a caller supplied buffer, so it can be sent by a single write.
+* Replies are decoded incrementally from whatever block of bytes is
+* currently available, the decoder keeps its state between calls.
+* Runs of bytes which need no wrapping are found by SSE2/AVX2 compares
+* (when the compiler targets them) and copied in blocks, their checksum
+* is summed in the same pass.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#include <stdint.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "RobbusFrame.h"
+#include "RobbusComm.h"
+
+// bytes checked one by one before trying whole blocks
+#define ROBBUS_FRAME_SCALAR_PREFIX 8
+
+static int m_vectorized = 1;
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief enable block processing by vector instructions
+*
+* For comparison with the plain byte loop, nothing changes when the
+* build does not target SSE2.
+*/
+void RobbusFrame_SetVectorized(int enable) {
+	m_vectorized = enable;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief copy leading bytes which need no wrapping and add them to checksum
+*
+* Whole blocks are compared at once, writes only the copied bytes to dst.
+*
+* \return number of bytes copied, src[return] is the first special one
+*/
+static size_t RobbusFrame_CopyClean(uint8_t *dst, const uint8_t *src, size_t size, uint8_t *checkSum) {
+	uint8_t sum = *checkSum; // local, stores to dst could alias it
+	size_t i;
+
+	// short runs between special characters are cheaper byte by byte
+	for (i = 0; i < size && i < ROBBUS_FRAME_SCALAR_PREFIX; i++) {
+		if (src[i] < ROBBUS_SPECIAL_CHAR_SHIFT) {
+			*checkSum = sum;
+			return i;
+		}
+		dst[i] = src[i];
+		sum += src[i];
+	}
+
+#if defined(__AVX2__)
+	if (m_vectorized && size >= 32) {
+		const __m256i limit = _mm256_set1_epi8(ROBBUS_SPECIAL_CHAR_SHIFT - 1);
+		const __m256i zero = _mm256_setzero_si256();
+		__m256i sums = zero;
+
+		for (; i + 32 <= size; i += 32) {
+			__m256i block = _mm256_loadu_si256((const __m256i*)(src + i));
+			// unsigned "less than 4" as min(x, 3) == x
+			if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(block, limit), block)) != 0)
+				break;
+			_mm256_storeu_si256((__m256i*)(dst + i), block);
+			sums = _mm256_add_epi64(sums, _mm256_sad_epu8(block, zero));
+		}
+		sum += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1)
+			+ _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+	}
+#endif
+#if defined(__SSE2__)
+	if (m_vectorized && i + 16 <= size) {
+		const __m128i limit = _mm_set1_epi8(ROBBUS_SPECIAL_CHAR_SHIFT - 1);
+		const __m128i zero = _mm_setzero_si128();
+		__m128i sums = zero;
+
+		for (; i + 16 <= size; i += 16) {
+			__m128i block = _mm_loadu_si128((const __m128i*)(src + i));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(block, limit), block)) != 0)
+				break;
+			_mm_storeu_si128((__m128i*)(dst + i), block);
+			sums = _mm_add_epi64(sums, _mm_sad_epu8(block, zero));
+		}
+		sum += _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+	}
+#endif
+	// rest of the block with the special character and the tail
+	for (; i < size && src[i] >= ROBBUS_SPECIAL_CHAR_SHIFT; i++) {
+		dst[i] = src[i];
+		sum += src[i];
+	}
+	*checkSum = sum;
+	return i;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief start new frame
+*
+* Tag and address are stored as they are, address is included in the checksum.
+*/
+void RobbusFrame_Begin(RobbusFrame_Builder_t *builder, uint8_t *buffer, uint8_t tag, uint8_t address) {
+	builder->buffer = buffer;
+	builder->buffer[0] = tag;
+	builder->buffer[1] = address;
+	builder->length = 2;
+	builder->checkSum = address;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief append single byte, wrap it if it is a special character
+*/
+void RobbusFrame_PutByte(RobbusFrame_Builder_t *builder, uint8_t c) {
+	if (c < ROBBUS_SPECIAL_CHAR_SHIFT) {
+		builder->buffer[builder->length++] = ROBBUS_SPECIAL_CHAR_PREFIX;
+		builder->buffer[builder->length++] = c + ROBBUS_SPECIAL_CHAR_SHIFT;
+	} else {
+		builder->buffer[builder->length++] = c;
+	}
+	builder->checkSum += c;
+}
+
+void RobbusFrame_PutData(RobbusFrame_Builder_t *builder, const uint8_t *data, size_t size) {
+	size_t i = 0;
+	while (i < size) {
+		size_t run = RobbusFrame_CopyClean(builder->buffer + builder->length, data + i, size - i, &builder->checkSum);
+		builder->length += run;
+		i += run;
+		if (i < size) {
+			RobbusFrame_PutByte(builder, data[i++]);
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief append checksum
+*
+* \return total length of the frame
+*/
+size_t RobbusFrame_End(RobbusFrame_Builder_t *builder) {
+	uint8_t checkSum = (~builder->checkSum)+1;
+	RobbusFrame_PutByte(builder, checkSum);
+	return builder->length;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief build complete frame with given payload
+*
+* \return total length of the frame
+*/
+size_t RobbusFrame_Build(uint8_t *buffer, uint8_t tag, uint8_t address, const uint8_t *data, uint8_t size) {
+	RobbusFrame_Builder_t builder;
+
+	RobbusFrame_Begin(&builder, buffer, tag, address);
+	RobbusFrame_PutByte(&builder, size);
+	RobbusFrame_PutData(&builder, data, size);
+	return RobbusFrame_End(&builder);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief start multi node frame
+*
+* \param bodyLength total size of all sections including their headers
+*/
+void RobbusFrame_BeginMulti(RobbusFrame_Builder_t *builder, uint8_t *buffer, uint8_t bodyLength) {
+	RobbusFrame_Begin(builder, buffer, ROBBUS_TAG_REGULAR, ROBBUS_MULTI_ADDRESS);
+	RobbusFrame_PutByte(builder, bodyLength);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief append payload for one node to multi node frame
+*/
+void RobbusFrame_PutSection(RobbusFrame_Builder_t *builder, uint8_t address, const uint8_t *data, uint8_t size) {
+	RobbusFrame_PutByte(builder, address);
+	RobbusFrame_PutByte(builder, size);
+	RobbusFrame_PutData(builder, data, size);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief build group frame, accepted without reply by all nodes with
+* (address & mask) == (node address & mask)
+*
+* Unlike the node address the mask may be a special character, both
+* are wrapped and included in the checksum.
+*
+* \return total length of the frame
+*/
+size_t RobbusFrame_BuildGroup(uint8_t *buffer, uint8_t address, uint8_t mask, const uint8_t *data, uint8_t size) {
+	RobbusFrame_Builder_t builder;
+
+	builder.buffer = buffer;
+	builder.buffer[0] = ROBBUS_TAG_GROUP;
+	builder.length = 1;
+	builder.checkSum = 0;
+	RobbusFrame_PutByte(&builder, address);
+	RobbusFrame_PutByte(&builder, mask);
+	RobbusFrame_PutByte(&builder, size);
+	RobbusFrame_PutData(&builder, data, size);
+	return RobbusFrame_End(&builder);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief build group packet all matching nodes reply to
+*
+* \param slotWidth time between starts of two replies in ROBBUS_GROUP_READ_SLOT_UNIT_US
+* \param size payload size, at most 254 as slot width takes one byte
+*/
+size_t RobbusFrame_BuildGroupRead(uint8_t *buffer, uint8_t address, uint8_t mask, uint8_t slotWidth, const uint8_t *data, uint8_t size) {
+	RobbusFrame_Builder_t builder;
+
+	builder.buffer = buffer;
+	builder.buffer[0] = ROBBUS_TAG_GROUP;
+	builder.length = 1;
+	builder.checkSum = 0;
+	RobbusFrame_PutByte(&builder, address | ROBBUS_GROUP_READ_FLAG);
+	RobbusFrame_PutByte(&builder, mask);
+	RobbusFrame_PutByte(&builder, size + 1);
+	RobbusFrame_PutByte(&builder, slotWidth);
+	RobbusFrame_PutData(&builder, data, size);
+	return RobbusFrame_End(&builder);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief prepare decoder for a reply
+*
+* \param tag expected tag
+* \param address expected node address or ROBBUS_FRAME_ANY_ADDRESS
+* \param data where to store the payload
+* \param capacity size of data
+*/
+void RobbusFrame_DecoderInit(RobbusFrame_Decoder_t *decoder, uint8_t tag, uint8_t address, uint8_t *data, uint8_t capacity) {
+	decoder->state = ROBBUS_FRAME_STATE_TAG;
+	decoder->tag = tag;
+	decoder->address = address;
+	decoder->data = data;
+	decoder->capacity = capacity;
+	decoder->length = 0;
+	decoder->index = 0;
+	decoder->checkSum = 0;
+	decoder->special = 0;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief feed block of received bytes into the decoder
+*
+* Stops right after the end of the frame, so following bytes are left
+* for the next frame.
+*
+* \param bytes received bytes
+* \param size number of bytes
+* \param consumed set to the number of bytes used
+* \return RBC_PENDING when more bytes are needed, RBC_SUCCESS when complete
+* frame was received or one of the RBC_ error codes
+*/
+int RobbusFrame_Decode(RobbusFrame_Decoder_t *decoder, const uint8_t *bytes, size_t size, size_t *consumed) {
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		uint8_t c;
+
+		// payload bytes up to the next special character are copied at once
+		if (decoder->state == ROBBUS_FRAME_STATE_DATA && !decoder->special) {
+			size_t run = decoder->length - decoder->index;
+			if (run > size - i)
+				run = size - i;
+			run = RobbusFrame_CopyClean(decoder->data + decoder->index, bytes + i, run, &decoder->checkSum);
+			decoder->index += run;
+			i += run;
+			if (decoder->index == decoder->length)
+				decoder->state = ROBBUS_FRAME_STATE_CHECKSUM;
+			if (i == size)
+				break;
+		}
+		c = bytes[i];
+
+		// tag and address are never wrapped
+		if (decoder->state == ROBBUS_FRAME_STATE_TAG) {
+			if (c != decoder->tag) {
+				*consumed = i + 1;
+				return RBC_TAG;
+			}
+			decoder->state = ROBBUS_FRAME_STATE_ADDRESS;
+			continue;
+		}
+		if (decoder->state == ROBBUS_FRAME_STATE_ADDRESS) {
+			if (decoder->address == ROBBUS_FRAME_ANY_ADDRESS && (c & ROBBUS_ADDRESS_REPLY_MASK)) {
+				decoder->address = c & ~ROBBUS_ADDRESS_REPLY_MASK;
+			} else if (c != (decoder->address | ROBBUS_ADDRESS_REPLY_MASK)) {
+				*consumed = i + 1;
+				return RBC_ADDRESS;
+			}
+			decoder->checkSum = c;
+			decoder->state = ROBBUS_FRAME_STATE_LENGTH;
+			continue;
+		}
+
+		// special characters handling
+		if (c == ROBBUS_SPECIAL_CHAR_PREFIX) {
+			decoder->special = 1;
+			continue;
+		}
+		if (c < ROBBUS_SPECIAL_CHAR_SHIFT) { // start of another packet
+			*consumed = i;
+			return RBC_TAG;
+		}
+		if (decoder->special) {
+			decoder->special = 0;
+			c -= ROBBUS_SPECIAL_CHAR_SHIFT;
+		}
+		decoder->checkSum += c;
+
+		switch (decoder->state) {
+			case ROBBUS_FRAME_STATE_LENGTH:
+				if (c > decoder->capacity) {
+					*consumed = i + 1;
+					return RBC_LENGTH;
+				}
+				decoder->length = c;
+				decoder->state = c > 0 ? ROBBUS_FRAME_STATE_DATA : ROBBUS_FRAME_STATE_CHECKSUM;
+				break;
+			case ROBBUS_FRAME_STATE_DATA:
+				decoder->data[decoder->index++] = c;
+				if (decoder->index == decoder->length)
+					decoder->state = ROBBUS_FRAME_STATE_CHECKSUM;
+				break;
+			case ROBBUS_FRAME_STATE_CHECKSUM:
+				decoder->state = ROBBUS_FRAME_STATE_DONE;
+				*consumed = i + 1;
+				return decoder->checkSum == 0 ? RBC_SUCCESS : RBC_CHECKSUM;
+			default:
+				*consumed = i + 1;
+				return RBC_TAG;
+		}
+	}
+
+	*consumed = size;
+	return RBC_PENDING;
+}
@@ -0,0 +1,87 @@
+/*!
+* \file RobbusFrame.h
+* \brief building of robbus frames in memory
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#ifndef ROBBUS_FRAME_H
+#define ROBBUS_FRAME_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// packet special character prefix and shift
+#define ROBBUS_SPECIAL_CHAR_PREFIX 0x00
+#define ROBBUS_SPECIAL_CHAR_SHIFT 0x04
+
+// value added to the address in replies
+#define ROBBUS_ADDRESS_REPLY_MASK 0x80
+
+/// longest possible frame: tag, address, wrapped length, wrapped payload and wrapped checksum
+#define ROBBUS_FRAME_MAX_SIZE (2 + 2 * (1 + 255 + 1))
+
+// multi node packet: regular tag, this address (reply of nonexistent node 0,
+// so older nodes ignore it), body length and sections of address, length, payload;
+// nodes take their section and do not reply
+#define ROBBUS_MULTI_ADDRESS ROBBUS_ADDRESS_REPLY_MASK
+#define ROBBUS_MULTI_SECTION_OVERHEAD 2
+#define ROBBUS_MULTI_BODY_MAX 255
+
+// group read packet: group tag, address with this flag, mask, length,
+// slot width and payload; every matching node replies in slot given
+// by its address bits not covered by the mask
+#define ROBBUS_GROUP_READ_FLAG 0x80
+#define ROBBUS_GROUP_READ_SLOT_UNIT_US 10
+
+/// decoder address accepting reply of any node
+#define ROBBUS_FRAME_ANY_ADDRESS 0xff
+
+typedef struct {
+	uint8_t	*buffer;	//! frame being built (at least ROBBUS_FRAME_MAX_SIZE bytes)
+	size_t	length;		//! bytes used so far
+	uint8_t	checkSum;	//! running checksum of the frame content
+} RobbusFrame_Builder_t;
+
+typedef enum {
+	ROBBUS_FRAME_STATE_TAG = 0,
+	ROBBUS_FRAME_STATE_ADDRESS,
+	ROBBUS_FRAME_STATE_LENGTH,
+	ROBBUS_FRAME_STATE_DATA,
+	ROBBUS_FRAME_STATE_CHECKSUM,
+	ROBBUS_FRAME_STATE_DONE
+} RobbusFrame_DecoderState_t;
+
+typedef struct {
+	RobbusFrame_DecoderState_t	state;
+	uint8_t	tag;		//! expected tag
+	uint8_t	address;	//! expected node address (without reply mask), received one for ROBBUS_FRAME_ANY_ADDRESS
+	uint8_t	*data;		//! payload destination
+	uint8_t	capacity;	//! payload destination size
+	uint8_t	length;		//! payload length announced by the frame
+	uint8_t	index;		//! payload bytes decoded so far
+	uint8_t	checkSum;	//! running checksum
+	uint8_t	special;	//! previous byte was special character prefix
+} RobbusFrame_Decoder_t;
+
+void RobbusFrame_SetVectorized(int enable);
+
+void RobbusFrame_Begin(RobbusFrame_Builder_t *builder, uint8_t *buffer, uint8_t tag, uint8_t address);
+void RobbusFrame_PutByte(RobbusFrame_Builder_t *builder, uint8_t c);
+void RobbusFrame_PutData(RobbusFrame_Builder_t *builder, const uint8_t *data, size_t size);
+size_t RobbusFrame_End(RobbusFrame_Builder_t *builder);
+
+size_t RobbusFrame_Build(uint8_t *buffer, uint8_t tag, uint8_t address, const uint8_t *data, uint8_t size);
+void RobbusFrame_BeginMulti(RobbusFrame_Builder_t *builder, uint8_t *buffer, uint8_t bodyLength);
+void RobbusFrame_PutSection(RobbusFrame_Builder_t *builder, uint8_t address, const uint8_t *data, uint8_t size);
+size_t RobbusFrame_BuildGroup(uint8_t *buffer, uint8_t address, uint8_t mask, const uint8_t *data, uint8_t size);
+size_t RobbusFrame_BuildGroupRead(uint8_t *buffer, uint8_t address, uint8_t mask, uint8_t slotWidth, const uint8_t *data, uint8_t size);
+
+void RobbusFrame_DecoderInit(RobbusFrame_Decoder_t *decoder, uint8_t tag, uint8_t address, uint8_t *data, uint8_t capacity);
+int RobbusFrame_Decode(RobbusFrame_Decoder_t *decoder, const uint8_t *bytes, size_t size, size_t *consumed);
+
+#endif
@@ -0,0 +1,230 @@
+/*!
+* \file RobbusLog.c
+* \brief leveled logging which does not block the bus loops
+*
+* Producer owns head of its ring, the logging thread owns tail, both are
+* published by release stores so records need no lock.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "RobbusLog.h"
+
+#define ROBBUS_LOG_NAME_SIZE 32
+
+typedef struct {
+	unsigned long long timeUs;
+	const char	*format;
+	long		args[ROBBUS_LOG_ARGS];
+	int		level;
+} RobbusLog_Record_t;
+
+/// single producer single consumer ring
+typedef struct {
+	char		name[ROBBUS_LOG_NAME_SIZE];
+	unsigned	head __attribute__((aligned(64)));	//! next record written by the producer
+	unsigned long	dropped;	//! records lost because the ring was full
+	unsigned	tail __attribute__((aligned(64)));	//! next record read by the logging thread
+	unsigned long	droppedReported;
+	RobbusLog_Record_t records[ROBBUS_LOG_RING_SIZE];
+} RobbusLog_Ring_t;
+
+static const char *g_levelNames[] = {"ERROR", "WARNING", "INFO", "DEBUG"};
+
+static int g_level = ROBBUS_LOG_DEFAULT_LEVEL;
+static FILE *g_stream;
+static unsigned long long g_startUs;
+static pthread_t g_thread;
+static int g_running;
+static int g_stop;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;	//! rings list and direct writes
+static RobbusLog_Ring_t *g_rings[ROBBUS_LOG_MAX_RINGS];
+static int g_ringCount;
+static __thread RobbusLog_Ring_t *t_ring;
+
+static unsigned long long RobbusLog_Now(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+static void RobbusLog_Format(FILE *stream, const char *name, const RobbusLog_Record_t *record) {
+	unsigned long long us = record->timeUs > g_startUs ? record->timeUs - g_startUs : 0;
+
+	flockfile(stream);
+	fprintf(stream, "%6llu.%06llu %-7s %s: ", us / 1000000ULL, us % 1000000ULL,
+		g_levelNames[record->level], name);
+	fprintf(stream, record->format, record->args[0], record->args[1], record->args[2],
+		record->args[3], record->args[4], record->args[5]);
+	fputc('\n', stream);
+	funlockfile(stream);
+}
+
+/// format everything the ring holds, logging thread only
+static int RobbusLog_Drain(RobbusLog_Ring_t *ring) {
+	unsigned head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	unsigned long dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+	unsigned tail = ring->tail;
+	int count = head - tail;
+
+	for (; tail != head; tail++)
+		RobbusLog_Format(g_stream, ring->name, &ring->records[tail & (ROBBUS_LOG_RING_SIZE - 1)]);
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+	if (dropped != ring->droppedReported) {
+		fprintf(g_stream, "%s: %lu log record(s) dropped\n", ring->name, dropped - ring->droppedReported);
+		ring->droppedReported = dropped;
+	}
+	return count;
+}
+
+static void *RobbusLog_Loop(void *arg) {
+	int stop;
+
+	do {
+		struct timespec delay;
+		int i, ringCount, records = 0;
+
+		pthread_mutex_lock(&g_lock);
+		stop = g_stop;
+		ringCount = g_ringCount;
+		pthread_mutex_unlock(&g_lock);
+
+		for (i = 0; i < ringCount; i++)
+			records += RobbusLog_Drain(g_rings[i]);
+		if (records > 0)
+			fflush(g_stream);
+
+		delay.tv_sec = 0;
+		delay.tv_nsec = ROBBUS_LOG_FLUSH_US * 1000L;
+		if (!stop)
+			nanosleep(&delay, NULL);
+	} while (!stop);
+	return NULL;
+}
+
+void RobbusLog_SetLevel(int level) {
+	__atomic_store_n(&g_level, level, __ATOMIC_RELAXED);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief start the logging thread writing to given stream
+*/
+int RobbusLog_Start(FILE *stream) {
+	pthread_mutex_lock(&g_lock);
+	g_stream = stream;
+	g_stop = 0;
+	if (g_startUs == 0)
+		g_startUs = RobbusLog_Now();
+	pthread_mutex_unlock(&g_lock);
+
+	if (pthread_create(&g_thread, NULL, RobbusLog_Loop, NULL) != 0) {
+		perror("Starting logging thread failed");
+		return 1;
+	}
+	g_running = 1;
+	return 0;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief write what is left in the rings and stop the logging thread
+*
+* Attached threads have to be done logging, later records are written
+* at once. Rings are kept for a next start.
+*/
+void RobbusLog_Stop(void) {
+	if (!g_running)
+		return;
+	pthread_mutex_lock(&g_lock);
+	g_stop = 1;
+	pthread_mutex_unlock(&g_lock);
+	pthread_join(g_thread, NULL);
+	g_running = 0;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief give calling thread its own ring
+*
+* \param name shown in the records of the thread
+*/
+int RobbusLog_Attach(const char *name) {
+	RobbusLog_Ring_t *ring;
+
+	if (t_ring != NULL)
+		return 0;
+	ring = calloc(1, sizeof(RobbusLog_Ring_t));
+	if (ring == NULL) {
+		perror("Log ring allocation failed");
+		return 1;
+	}
+	strncpy(ring->name, name, ROBBUS_LOG_NAME_SIZE - 1);
+
+	pthread_mutex_lock(&g_lock);
+	if (g_ringCount == ROBBUS_LOG_MAX_RINGS) {
+		pthread_mutex_unlock(&g_lock);
+		free(ring);
+		return 1; // logs directly then
+	}
+	g_rings[g_ringCount++] = ring;
+	pthread_mutex_unlock(&g_lock);
+	t_ring = ring;
+	return 0;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief log one record, use the ROBBUS_LOG() macros instead
+*/
+void RobbusLog_Put(int level, const char *format, long a0, long a1, long a2, long a3, long a4, long a5, ...) {
+	RobbusLog_Ring_t *ring = t_ring;
+	RobbusLog_Record_t *record, direct;
+	unsigned head = 0;
+
+	if (level > __atomic_load_n(&g_level, __ATOMIC_RELAXED))
+		return;
+
+	if (ring == NULL || !g_running) {
+		record = &direct;
+	} else {
+		head = ring->head;
+		if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == ROBBUS_LOG_RING_SIZE) {
+			__atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+			return;
+		}
+		record = &ring->records[head & (ROBBUS_LOG_RING_SIZE - 1)];
+	}
+
+	record->timeUs = RobbusLog_Now();
+	record->format = format;
+	record->args[0] = a0;
+	record->args[1] = a1;
+	record->args[2] = a2;
+	record->args[3] = a3;
+	record->args[4] = a4;
+	record->args[5] = a5;
+	record->level = level;
+
+	if (record != &direct) {
+		__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+		return;
+	}
+	pthread_mutex_lock(&g_lock);
+	if (g_startUs == 0)
+		g_startUs = record->timeUs;
+	RobbusLog_Format(g_stream != NULL ? g_stream : stdout, ring != NULL ? ring->name : "main", record);
+	pthread_mutex_unlock(&g_lock);
+}
@@ -0,0 +1,51 @@
+/*!
+* \file RobbusLog.h
+* \brief leveled logging which does not block the bus loops
+*
+* Each thread attached by RobbusLog_Attach() gets its own single producer
+* ring of binary records, the logging thread formats and writes them.
+* A full ring drops records (their count is reported) instead of waiting.
+* Records of threads not attached and all records before RobbusLog_Start()
+* are written at once in the same format.
+*
+* Format is a string literal (only its pointer is stored) taking up to
+* ROBBUS_LOG_ARGS long arguments, i.e. "Node %02lx synced".
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#ifndef ROBBUS_LOG_H
+#define ROBBUS_LOG_H
+
+#include <stdio.h>
+
+#define ROBBUS_LOG_ERROR 0
+#define ROBBUS_LOG_WARNING 1
+#define ROBBUS_LOG_INFO 2
+#define ROBBUS_LOG_DEBUG 3
+
+#define ROBBUS_LOG_DEFAULT_LEVEL ROBBUS_LOG_INFO
+#define ROBBUS_LOG_ARGS 6
+/// records per thread, power of two
+#define ROBBUS_LOG_RING_SIZE 1024
+#define ROBBUS_LOG_MAX_RINGS 32
+/// how often the logging thread looks for new records
+#define ROBBUS_LOG_FLUSH_US 10000
+
+#define ROBBUS_LOG(level, ...) RobbusLog_Put(level, __VA_ARGS__, 0L, 0L, 0L, 0L, 0L, 0L)
+#define RobbusLog_Error(...) ROBBUS_LOG(ROBBUS_LOG_ERROR, __VA_ARGS__)
+#define RobbusLog_Warning(...) ROBBUS_LOG(ROBBUS_LOG_WARNING, __VA_ARGS__)
+#define RobbusLog_Info(...) ROBBUS_LOG(ROBBUS_LOG_INFO, __VA_ARGS__)
+#define RobbusLog_Debug(...) ROBBUS_LOG(ROBBUS_LOG_DEBUG, __VA_ARGS__)
+
+void RobbusLog_SetLevel(int level);
+int RobbusLog_Start(FILE *stream);
+void RobbusLog_Stop(void);
+int RobbusLog_Attach(const char *name);
+void RobbusLog_Put(int level, const char *format, long a0, long a1, long a2, long a3, long a4, long a5, ...);
+
+#endif
@@ -15,15 +15,31 @@
 #include <string.h>
 
 #include "RobbusNodeList.h"
+#include "RobbusShm.h"
 
 static RobbusNodeList_Descriptor_t *g_nodeList = NULL;
 static int g_nodeCount = 0;
 static RobbusNodeList_Descriptor_t **g_nodeArray;
+static RobbusNodeList_Descriptor_t *g_retiredList = NULL; //! list replaced by reload
 
 int RobbusNodeList_PrintNode(RobbusNodeList_Descriptor_t *node) {
-	printf("Node %02x: in: %d (offset: %d) out: %d (offset: %d) name: %s\n",
+	printf("Node %02x: in: %d (offset: %d) out: %d (offset: %d) name: %s%s%s",
 	node->address,node->inDataSize, node->inDataOffset, 
-	node->outDataSize, node->outDataOffset, node->name);
+	node->outDataSize, node->outDataOffset, node->name,
+	node->bus[0] ? " bus: " : "", node->bus);
+	if (node->groupEnabled)
+		printf(" group: %02x/%02x", node->groupAddress, node->groupMask);
+	if (node->groupRead)
+		printf(" read");
+	if (node->multiWrite)
+		printf(" multi");
+	if (node->changeOnly)
+		printf(" delta");
+	if (node->periodUs)
+		printf(" period: %lu us", node->periodUs);
+	if (node->removed)
+		printf(" removed");
+	printf("\n");
 
 	return 0;
 }
@@ -37,52 +53,127 @@ int RobbusNodeList_PrintList(void) {
 	return 0;
 }
 
-int RobbusNodeList_Delete(void) {
-	RobbusNodeList_Descriptor_t *node = g_nodeList;
-	while (g_nodeList != NULL) {
-		node = g_nodeList;
-		g_nodeList = g_nodeList->next;
+static void RobbusNodeList_Free(RobbusNodeList_Descriptor_t *list) {
+	RobbusNodeList_Descriptor_t *node;
+	while (list != NULL) {
+		node = list;
+		list = list->next;
 		free(node);
 	}
+}
+
+int RobbusNodeList_Delete(void) {
+	RobbusNodeList_Free(g_nodeList);
+	g_nodeList = NULL;
+	RobbusNodeList_DeleteRetired();
 	free(g_nodeArray);
 	return 0;
 }	
 
-int RobbusNodeList_Create(const char *configFileName) {
+///////////////////////////////////////////////////////////
+/*!
+* \brief parse optional key=value columns following the node name
+*
+* Columns are separated by ':', i.e. "4:1:2:motor:bus=/dev/robbus1:group=0x04/0x7c:multi=1".
+* "groupread=1" tells the node answers group packets (its output is read by them then),
+* "delta=1" that it understands change only packets, "period=10000" the time
+* in us between its transactions (synced every round without it).
+*/
+static int RobbusNodeList_ParseOptions(RobbusNodeList_Descriptor_t *node, char *options) {
+	char *option, *save;
+
+	for (option = strtok_r(options, ": \t\r\n", &save); option != NULL;
+		option = strtok_r(NULL, ": \t\r\n", &save)) {
+		char *value = strchr(option, '=');
+		if (value == NULL) {
+			printf("Node %d: option %s has no value\n", node->address, option);
+			return 1;
+		}
+		*value++ = '\0';
+
+		if (strcmp(option, "bus") == 0) {
+			strncpy(node->bus, value, ROBBUS_NODE_BUS_SIZE-1);
+			node->bus[ROBBUS_NODE_BUS_SIZE-1] = '\0';
+		} else if (strcmp(option, "group") == 0) {
+			// address/mask of group packets the node accepts
+			char *end;
+			unsigned long address = strtoul(value, &end, 0), mask = 0;
+			if (*end == '/')
+				mask = strtoul(end + 1, &end, 0);
+			if (*end != '\0' || address > 0x7f || mask > 0xff
+				|| (address & mask) != (node->address & mask)) {
+				printf("Node %d: group %s does not match the node\n", node->address, value);
+				return 1;
+			}
+			node->groupEnabled = 1;
+			node->groupAddress = address;
+			node->groupMask = mask;
+		} else if (strcmp(option, "groupread") == 0) {
+			node->groupRead = atoi(value) != 0;
+		} else if (strcmp(option, "multi") == 0) {
+			node->multiWrite = atoi(value) != 0;
+		} else if (strcmp(option, "delta") == 0) {
+			node->changeOnly = atoi(value) != 0;
+		} else if (strcmp(option, "period") == 0) {
+			char *end;
+			node->periodUs = strtoul(value, &end, 0);
+			if (*end != '\0') {
+				printf("Node %d: period %s is not a number of us\n", node->address, value);
+				return 1;
+			}
+		} else {
+			printf("Node %d: unknown option %s\n", node->address, option);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief read config into a new list, slots follow the file order
+*
+* \return number of nodes, -1 if the file cannot be opened
+*/
+static int RobbusNodeList_Parse(const char *configFileName, RobbusNodeList_Descriptor_t **list) {
 	FILE* f;
 	char line[255];
-	int i;
-	RobbusNodeList_Descriptor_t *node, *lastNode = g_nodeList;
+	int count = 0, optionsOffset;
+	RobbusNodeList_Descriptor_t *node, *lastNode = NULL;
 
 	printf("Reading config file %s\n", configFileName);
 	f = fopen(configFileName, "r");
 	
 	if (f == NULL) {
 		perror("Unable to open config file");
-		return 1;
+		return -1;
 	}
 
-	g_nodeCount = 0;
-
+	*list = NULL;
 	while(fgets(line, 255, f) != NULL) {
 		if (strlen(line) < 4 || line [0] == '#')
 			continue;
 
-		node = malloc(sizeof(RobbusNodeList_Descriptor_t));
+		node = calloc(1, sizeof(RobbusNodeList_Descriptor_t));
 		node->next = NULL;
-		if(sscanf(line, "%d:%d:%d:%s", 
+		node->busIndex = -1;
+		if(sscanf(line, "%u:%u:%u:%19[^: \t\r\n]%n", 
 			&node->address, &node->inDataSize, 
-			&node->outDataSize, node->name) < 4) {
+			&node->outDataSize, node->name, &optionsOffset) < 4) {
 			perror("Line parsing failed");
 			free(node);
 			continue;
 		}
+		if (RobbusNodeList_ParseOptions(node, line + optionsOffset) != 0) {
+			free(node);
+			continue;
+		}
 
 		// add to list
-		if (g_nodeList == NULL) {
+		if (*list == NULL) {
 			node->inDataOffset = 0;
 			node->outDataOffset = 0;
-			g_nodeList = node;
+			*list = node;
 		} else {
 			node->inDataOffset = 
 				lastNode->inDataOffset + lastNode->inDataSize + ROBBUS_NODE_OVERHEAD_OFFSET;
@@ -92,23 +183,264 @@ int RobbusNodeList_Create(const char *configFileName) {
 		}
 		lastNode = node;
 
-		g_nodeCount++;
+		count++;
 	}
 
 	fclose(f);
+	return count;
+}
+
+/// construct array of pointers
+static void RobbusNodeList_BuildArray(void) {
+	RobbusNodeList_Descriptor_t *node = g_nodeList;
+	int i = 0;
 
-	// construct array of pointers
 	g_nodeArray = malloc(g_nodeCount * sizeof(RobbusNodeList_Descriptor_t*));
-	node = g_nodeList;
-	i = 0;
 	while (node != NULL) {
 		g_nodeArray[i++] = node;
 		node = node->next;
 	}
+}
 
+int RobbusNodeList_Create(const char *configFileName) {
+	g_nodeCount = RobbusNodeList_Parse(configFileName, &g_nodeList);
+	if (g_nodeCount < 0) {
+		g_nodeCount = 0;
+		return 1;
+	}
+	RobbusNodeList_BuildArray();
 	return 0;
 }
 
+/// options which may change without moving the node slots
+static int RobbusNodeList_SameOptions(const RobbusNodeList_Descriptor_t *a, const RobbusNodeList_Descriptor_t *b) {
+	return strcmp(a->name, b->name) == 0 && a->groupEnabled == b->groupEnabled
+		&& a->groupAddress == b->groupAddress && a->groupMask == b->groupMask
+		&& a->groupRead == b->groupRead && a->multiWrite == b->multiWrite
+		&& a->changeOnly == b->changeOnly && a->periodUs == b->periodUs;
+}
+
+/// current node occupying the same slots, removed one if there is no live one
+static RobbusNodeList_Descriptor_t *RobbusNodeList_FindSlot(const RobbusNodeList_Descriptor_t *node, const char *matched) {
+	RobbusNodeList_Descriptor_t *found = NULL;
+	int i;
+
+	for (i = 0; i < g_nodeCount; i++) {
+		RobbusNodeList_Descriptor_t *old = g_nodeArray[i];
+		if (matched[i] || old->address != node->address || strcmp(old->bus, node->bus) != 0
+			|| old->inDataSize != node->inDataSize || old->outDataSize != node->outDataSize)
+			continue;
+		if (!old->removed)
+			return old;
+		if (found == NULL)
+			found = old;
+	}
+	return found;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief read changed config and merge it into the current list
+*
+* Nodes keep their slots, so the shared memory is not rebuilt. New nodes
+* (or nodes with new sizes) get slots appended after the last one,
+* removed nodes are left as tombstones (removed set) holding theirs,
+* a node coming back with the same sizes takes its old slots again.
+* Nodes which do not fit the limits are refused.
+*
+* The replaced list stays allocated (its descriptors may still be in use)
+* until RobbusNodeList_DeleteRetired(), a list retired before is freed.
+* Without changes the current list is kept.
+*
+* \param inDataLimit size of the input segment, the same for output
+* \return number of nodes added, removed or changed, -1 if the config cannot be read
+*/
+int RobbusNodeList_Reload(const char *configFileName, size_t inDataLimit, size_t outDataLimit) {
+	RobbusNodeList_Descriptor_t *list, *node, **position, *last = NULL;
+	size_t inEnd = RobbusNodeList_GetTotalInDataSize(), outEnd = RobbusNodeList_GetTotalOutDataSize();
+	char *matched;
+	int count, i, changes = 0;
+
+	count = RobbusNodeList_Parse(configFileName, &list);
+	if (count < 0)
+		return -1;
+	RobbusNodeList_DeleteRetired();
+	matched = calloc(g_nodeCount + 1, 1);
+
+	// nodes matching the current ones take their slots first ...
+	for (node = list; node != NULL; node = node->next) {
+		RobbusNodeList_Descriptor_t *old = RobbusNodeList_FindSlot(node, matched);
+		if (old == NULL) {
+			node->removed = 1; // no slot yet
+			continue;
+		}
+		for (i = 0; g_nodeArray[i] != old; i++)
+			;
+		matched[i] = 1;
+		node->inDataOffset = old->inDataOffset;
+		node->outDataOffset = old->outDataOffset;
+		if (old->removed) {
+			printf("Node %02x: added back\n", node->address);
+			changes++;
+		} else if (!RobbusNodeList_SameOptions(node, old)) {
+			printf("Node %02x: options changed\n", node->address);
+			changes++;
+		}
+	}
+
+	// ... the ones left get tombstones ...
+	for (i = 0; i < g_nodeCount; i++) {
+		if (matched[i])
+			continue;
+		if (!g_nodeArray[i]->removed) {
+			printf("Node %02x: removed\n", g_nodeArray[i]->address);
+			changes++;
+		}
+		count++;
+	}
+
+	// ... and the new ones are appended
+	for (position = &list; (node = *position) != NULL; ) {
+		if (!node->removed) {
+			last = node;
+			position = &node->next;
+			continue;
+		}
+		if (count > ROBBUS_SHM_LAYOUT_MAX_NODES
+			|| inEnd + node->inDataSize + ROBBUS_NODE_OVERHEAD_OFFSET > inDataLimit
+			|| outEnd + node->outDataSize + ROBBUS_NODE_OVERHEAD_OFFSET > outDataLimit) {
+			printf("Node %02x: no room for its slots, restart to add it\n", node->address);
+			*position = node->next;
+			free(node);
+			count--;
+			continue;
+		}
+		node->removed = 0;
+		node->inDataOffset = inEnd;
+		node->outDataOffset = outEnd;
+		inEnd += node->inDataSize + ROBBUS_NODE_OVERHEAD_OFFSET;
+		outEnd += node->outDataSize + ROBBUS_NODE_OVERHEAD_OFFSET;
+		printf("Node %02x: added\n", node->address);
+		changes++;
+		last = node;
+		position = &node->next;
+	}
+
+	for (i = 0; i < g_nodeCount; i++) {
+		if (matched[i])
+			continue;
+		node = malloc(sizeof(RobbusNodeList_Descriptor_t));
+		*node = *g_nodeArray[i];
+		node->removed = 1;
+		node->next = NULL;
+		if (last == NULL)
+			list = node;
+		else
+			last->next = node;
+		last = node;
+	}
+	free(matched);
+	if (changes == 0) {
+		RobbusNodeList_Free(list); // current descriptors stay
+		return 0;
+	}
+
+	g_retiredList = g_nodeList;
+	free(g_nodeArray);
+	g_nodeList = list;
+	g_nodeCount = count;
+	RobbusNodeList_BuildArray();
+	return changes;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief free list replaced by the last reload once nobody uses its descriptors
+*/
+void RobbusNodeList_DeleteRetired(void) {
+	RobbusNodeList_Free(g_retiredList);
+	g_retiredList = NULL;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief undo the last reload, its list is freed and the retired one is current again
+*/
+void RobbusNodeList_RestoreRetired(void) {
+	RobbusNodeList_Descriptor_t *node;
+
+	if (g_retiredList == NULL)
+		return;
+	RobbusNodeList_Free(g_nodeList);
+	free(g_nodeArray);
+	g_nodeList = g_retiredList;
+	g_retiredList = NULL;
+	g_nodeCount = 0;
+	for (node = g_nodeList; node != NULL; node = node->next)
+		g_nodeCount++;
+	RobbusNodeList_BuildArray();
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief publish node slots in the control segment for other processes
+*
+* Nodes not given to a bus thread (busIndex -1) are published as removed.
+*
+* \return 0, 1 if the list was too long for the layout (first nodes published)
+*/
+int RobbusNodeList_PublishLayout(void) {
+	RobbusShm_LayoutNode_t layout[ROBBUS_SHM_LAYOUT_MAX_NODES];
+	int i;
+
+	for (i = 0; i < g_nodeCount && i < ROBBUS_SHM_LAYOUT_MAX_NODES; i++) {
+		RobbusNodeList_Descriptor_t *node = g_nodeArray[i];
+		layout[i].address = node->address;
+		layout[i].removed = node->removed || node->busIndex < 0;
+		layout[i].bus = node->busIndex;
+		layout[i].inDataOffset = node->inDataOffset;
+		layout[i].inDataSize = node->inDataSize;
+		layout[i].outDataOffset = node->outDataOffset;
+		layout[i].outDataSize = node->outDataSize;
+	}
+	RobbusShm_PublishLayout(layout, i);
+	return i < g_nodeCount;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief take node slots published by robbus_sync instead of the config order
+*
+* Nodes robbus_sync does not sync are marked removed.
+*
+* \return layout generation, 0 if none is published (slots are left as they are)
+*/
+uint32_t RobbusNodeList_ReadLayout(void) {
+	RobbusShm_LayoutNode_t layout[ROBBUS_SHM_LAYOUT_MAX_NODES];
+	char used[ROBBUS_SHM_LAYOUT_MAX_NODES] = {0};
+	uint32_t count, generation = RobbusShm_ReadLayout(layout, &count);
+	RobbusNodeList_Descriptor_t *node;
+	uint32_t i;
+
+	if (generation == 0)
+		return 0;
+	for (node = g_nodeList; node != NULL; node = node->next) {
+		node->removed = 1;
+		for (i = 0; i < count; i++) {
+			if (used[i] || layout[i].removed || layout[i].address != node->address
+				|| layout[i].inDataSize != node->inDataSize || layout[i].outDataSize != node->outDataSize)
+				continue;
+			used[i] = 1;
+			node->removed = 0;
+			node->busIndex = layout[i].bus;
+			node->inDataOffset = layout[i].inDataOffset;
+			node->outDataOffset = layout[i].outDataOffset;
+			break;
+		}
+	}
+	return generation;
+}
+
 RobbusNodeList_Descriptor_t* RobbusNodeList_GetList(void) {
 	return g_nodeList;
 }
@@ -144,22 +476,27 @@ RobbusNodeList_Descriptor_t* RobbusNodeList_GetLastNode(void) {
 }
 
 
+// slots end with the last one only until reload moves them
 size_t RobbusNodeList_GetTotalInDataSize(void) {
-	RobbusNodeList_Descriptor_t *node = RobbusNodeList_GetLastNode();
-	if (node == NULL) {
-		return 0;
-	}
+	RobbusNodeList_Descriptor_t *node;
+	size_t size = 0;
 
-	return node->inDataOffset + node->inDataSize + ROBBUS_NODE_OVERHEAD_OFFSET;
+	for (node = g_nodeList; node != NULL; node = node->next) {
+		if (node->inDataOffset + node->inDataSize + ROBBUS_NODE_OVERHEAD_OFFSET > size)
+			size = node->inDataOffset + node->inDataSize + ROBBUS_NODE_OVERHEAD_OFFSET;
+	}
+	return size;
 }
 
 size_t RobbusNodeList_GetTotalOutDataSize(void) {
-	RobbusNodeList_Descriptor_t *node = RobbusNodeList_GetLastNode();
-	if (node == NULL) {
-		return 0;
-	}
+	RobbusNodeList_Descriptor_t *node;
+	size_t size = 0;
 
-	return node->outDataOffset + node->outDataSize + ROBBUS_NODE_OVERHEAD_OFFSET;
+	for (node = g_nodeList; node != NULL; node = node->next) {
+		if (node->outDataOffset + node->outDataSize + ROBBUS_NODE_OVERHEAD_OFFSET > size)
+			size = node->outDataOffset + node->outDataSize + ROBBUS_NODE_OVERHEAD_OFFSET;
+	}
+	return size;
 }
 
 int RobbusNodeList_GetNodeCount(void) {
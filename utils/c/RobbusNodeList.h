@@ -16,6 +16,7 @@
 
 #define ROBBUS_DEFAULT_NODE_LIST_CONFIG "/etc/robbus/nodes.conf"
 #define ROBBUS_NODE_OVERHEAD_OFFSET 1
+#define ROBBUS_NODE_BUS_SIZE 64
 
 typedef struct node_desc {
 	unsigned int	address;
@@ -24,6 +25,16 @@ typedef struct node_desc {
 	unsigned int	outDataOffset;
 	unsigned int	outDataSize; 
 	char		name[20];
+	char		bus[ROBBUS_NODE_BUS_SIZE];	//! device of the bus segment, empty for the default one
+	int		groupEnabled;	//! node may be written by group packet
+	uint8_t		groupAddress;	//! group packet address and mask matching the node
+	uint8_t		groupMask;
+	int		groupRead;	//! node replies to group packets in its time slot
+	int		multiWrite;	//! input may go by multi node packet (no reply is read then)
+	int		changeOnly;	//! input and output go by change only packets
+	unsigned long	periodUs;	//! target time between transactions, 0 for every round
+	int		removed;	//! left by reload, its slots stay reserved and are not synced
+	int		busIndex;	//! bus thread of robbus_sync syncing the node, -1 for none
 	struct node_desc*	next;
 } RobbusNodeList_Descriptor_t;
 
@@ -32,6 +43,11 @@ int RobbusNodeList_PrintNode(RobbusNodeList_Descriptor_t *node);
 int RobbusNodeList_PrintList(void);
 int RobbusNodeList_Delete(void);
 int RobbusNodeList_Create(const char *configFileName);
+int RobbusNodeList_Reload(const char *configFileName, size_t inDataLimit, size_t outDataLimit);
+void RobbusNodeList_DeleteRetired(void);
+void RobbusNodeList_RestoreRetired(void);
+int RobbusNodeList_PublishLayout(void);
+uint32_t RobbusNodeList_ReadLayout(void);
 RobbusNodeList_Descriptor_t* RobbusNodeList_GetByAddress(uint8_t address);
 RobbusNodeList_Descriptor_t* RobbusNodeList_GetByIndex(int index);
 size_t RobbusNodeList_GetTotalInDataSize(void);
@@ -0,0 +1,237 @@
+/*!
+* \file RobbusSched.c
+* \brief earliest deadline first scheduling of periodic node transactions
+*
+* Tasks waiting for their release are kept in a min-heap by release time,
+* released ones in another min-heap by deadline. A task taken by
+* RobbusSched_PopReady() is in neither until RobbusSched_Complete().
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "RobbusSched.h"
+
+/// binary min-heap of task indices
+typedef struct {
+	int	*items;
+	int	count;
+} RobbusSched_Heap_t;
+
+struct RobbusSched {
+	int		taskCount;
+	RobbusSched_Task_t *tasks;
+	RobbusSched_Heap_t waiting;	//! by release time
+	RobbusSched_Heap_t ready;	//! by deadline
+	unsigned long long startUs;
+};
+
+typedef unsigned long long (*RobbusSched_Key_t)(const RobbusSched_Task_t *task);
+
+static unsigned long long RobbusSched_ReleaseKey(const RobbusSched_Task_t *task) {
+	return task->releaseUs;
+}
+
+static unsigned long long RobbusSched_DeadlineKey(const RobbusSched_Task_t *task) {
+	return task->deadlineUs;
+}
+
+static void RobbusSched_Push(RobbusSched_t *sched, RobbusSched_Heap_t *heap, RobbusSched_Key_t key, int task) {
+	int position = heap->count++;
+
+	while (position > 0) {
+		int parent = (position - 1) / 2;
+		if (key(&sched->tasks[heap->items[parent]]) <= key(&sched->tasks[task]))
+			break;
+		heap->items[position] = heap->items[parent];
+		position = parent;
+	}
+	heap->items[position] = task;
+}
+
+static int RobbusSched_Pop(RobbusSched_t *sched, RobbusSched_Heap_t *heap, RobbusSched_Key_t key) {
+	int top, last, position = 0;
+
+	if (heap->count == 0)
+		return -1;
+	top = heap->items[0];
+	last = heap->items[--heap->count];
+	for (;;) {
+		int child = 2 * position + 1;
+		if (child >= heap->count)
+			break;
+		if (child + 1 < heap->count
+			&& key(&sched->tasks[heap->items[child + 1]]) < key(&sched->tasks[heap->items[child]]))
+			child++;
+		if (key(&sched->tasks[last]) <= key(&sched->tasks[heap->items[child]]))
+			break;
+		heap->items[position] = heap->items[child];
+		position = child;
+	}
+	heap->items[position] = last;
+	return top;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief CLOCK_MONOTONIC time in us
+*/
+unsigned long long RobbusSched_Now(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief create scheduler with all tasks released now
+*
+* \param periodsUs period of each task, 0 for as often as possible
+*/
+RobbusSched_t *RobbusSched_Create(int taskCount, const unsigned long *periodsUs) {
+	RobbusSched_t *sched = calloc(1, sizeof(RobbusSched_t));
+	int i;
+
+	if (sched == NULL) {
+		perror("Scheduler allocation failed");
+		return NULL;
+	}
+	sched->taskCount = taskCount;
+	sched->tasks = calloc(taskCount, sizeof(RobbusSched_Task_t));
+	sched->waiting.items = malloc(taskCount * sizeof(int));
+	sched->ready.items = malloc(taskCount * sizeof(int));
+	if (sched->tasks == NULL || sched->waiting.items == NULL || sched->ready.items == NULL) {
+		perror("Scheduler allocation failed");
+		RobbusSched_Destroy(sched);
+		return NULL;
+	}
+
+	sched->startUs = RobbusSched_Now();
+	for (i = 0; i < taskCount; i++) {
+		RobbusSched_Task_t *task = &sched->tasks[i];
+		task->periodUs = periodsUs[i];
+		task->releaseUs = sched->startUs;
+		task->deadlineUs = sched->startUs + task->periodUs;
+		RobbusSched_Push(sched, &sched->waiting, RobbusSched_ReleaseKey, i);
+	}
+	return sched;
+}
+
+void RobbusSched_Destroy(RobbusSched_t *sched) {
+	free(sched->tasks);
+	free(sched->waiting.items);
+	free(sched->ready.items);
+	free(sched);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief move tasks released by now to the ready ones
+*
+* \return number of ready tasks
+*/
+int RobbusSched_Release(RobbusSched_t *sched, unsigned long long nowUs) {
+	while (sched->waiting.count > 0 && sched->tasks[sched->waiting.items[0]].releaseUs <= nowUs) {
+		int task = RobbusSched_Pop(sched, &sched->waiting, RobbusSched_ReleaseKey);
+		RobbusSched_Push(sched, &sched->ready, RobbusSched_DeadlineKey, task);
+	}
+	return sched->ready.count;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief take ready task with the earliest deadline
+*
+* \return task index, -1 if none is ready
+*/
+int RobbusSched_PopReady(RobbusSched_t *sched) {
+	return RobbusSched_Pop(sched, &sched->ready, RobbusSched_DeadlineKey);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief return taken task and schedule its next release
+*
+* Task which fell a whole period behind skips the periods it missed
+* instead of running them back to back.
+*
+* \param ran 0 if the task had nothing to do
+*/
+void RobbusSched_Complete(RobbusSched_t *sched, int task, unsigned long long nowUs, int ran) {
+	RobbusSched_Task_t *t = &sched->tasks[task];
+
+	if (ran) {
+		t->runs++;
+		if (t->periodUs && nowUs > t->deadlineUs)
+			t->missed++;
+	}
+
+	if (t->periodUs == 0) {
+		t->releaseUs = ran ? nowUs : nowUs + ROBBUS_SCHED_IDLE_US;
+		t->deadlineUs = t->releaseUs;
+	} else {
+		t->releaseUs = t->deadlineUs;
+		if (nowUs >= t->releaseUs + t->periodUs) {
+			unsigned long long skipped = (nowUs - t->releaseUs) / t->periodUs;
+			t->missed += skipped;
+			t->releaseUs += skipped * t->periodUs;
+		}
+		t->deadlineUs = t->releaseUs + t->periodUs;
+	}
+	RobbusSched_Push(sched, &sched->waiting, RobbusSched_ReleaseKey, task);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief release tasks without period which wait because they had nothing to do
+*
+* Called when there may be something new for them.
+*/
+void RobbusSched_WakeIdle(RobbusSched_t *sched, unsigned long long nowUs) {
+	int count = sched->waiting.count, i;
+
+	sched->waiting.count = 0;
+	for (i = 0; i < count; i++) {
+		int task = sched->waiting.items[i];
+		RobbusSched_Task_t *t = &sched->tasks[task];
+		if (t->periodUs == 0 && t->releaseUs > nowUs) {
+			t->releaseUs = nowUs;
+			t->deadlineUs = nowUs;
+		}
+		// keys changed, build the heap again
+		RobbusSched_Push(sched, &sched->waiting, RobbusSched_ReleaseKey, task);
+	}
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief earliest release of a waiting task
+*
+* \return time in us, ~0ULL when no task waits
+*/
+unsigned long long RobbusSched_NextRelease(RobbusSched_t *sched) {
+	if (sched->waiting.count == 0)
+		return ~0ULL;
+	return sched->tasks[sched->waiting.items[0]].releaseUs;
+}
+
+const RobbusSched_Task_t *RobbusSched_GetTask(RobbusSched_t *sched, int task) {
+	return &sched->tasks[task];
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief runs per second since the scheduler was created
+*/
+double RobbusSched_GetRate(RobbusSched_t *sched, int task, unsigned long long nowUs) {
+	if (nowUs <= sched->startUs)
+		return 0.0;
+	return sched->tasks[task].runs * 1000000.0 / (nowUs - sched->startUs);
+}
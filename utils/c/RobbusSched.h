@@ -0,0 +1,43 @@
+/*!
+* \file RobbusSched.h
+* \brief earliest deadline first scheduling of periodic node transactions
+*
+* Every task is released once per its period and has to be done before
+* the next release. Released tasks are taken earliest deadline first,
+* tasks without period are released again right after they ran.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#ifndef ROBBUS_SCHED_H
+#define ROBBUS_SCHED_H
+
+/// task without period which had nothing to do waits this long, unless woken earlier
+#define ROBBUS_SCHED_IDLE_US 100000ULL
+
+typedef struct RobbusSched RobbusSched_t;
+
+typedef struct {
+	unsigned long	periodUs;	//! 0 to run as often as possible
+	unsigned long long releaseUs;	//! when the task may run next
+	unsigned long long deadlineUs;	//! when it has to be done by
+	unsigned long	runs;		//! completed runs with something to do
+	unsigned long	missed;		//! runs done after the deadline and periods skipped
+} RobbusSched_Task_t;
+
+unsigned long long RobbusSched_Now(void);
+RobbusSched_t *RobbusSched_Create(int taskCount, const unsigned long *periodsUs);
+void RobbusSched_Destroy(RobbusSched_t *sched);
+int RobbusSched_Release(RobbusSched_t *sched, unsigned long long nowUs);
+int RobbusSched_PopReady(RobbusSched_t *sched);
+void RobbusSched_Complete(RobbusSched_t *sched, int task, unsigned long long nowUs, int ran);
+void RobbusSched_WakeIdle(RobbusSched_t *sched, unsigned long long nowUs);
+unsigned long long RobbusSched_NextRelease(RobbusSched_t *sched);
+const RobbusSched_Task_t *RobbusSched_GetTask(RobbusSched_t *sched, int task);
+double RobbusSched_GetRate(RobbusSched_t *sched, int task, unsigned long long nowUs);
+
+#endif
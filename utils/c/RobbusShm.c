@@ -19,6 +19,12 @@
 #include <unistd.h> /* fork(), etc. */
 #include <stdlib.h> /* rand(), etc. */
 #include <string.h>
+#include <sched.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #define SEM_ID 250 /* ID for the semaphore. */
 
 #include "RobbusShm.h"
@@ -36,13 +42,18 @@ typedef struct {
 	int key;
 	int memHandle;
 	void *memPtr;
-	int semHandle;
+	int semHandle;	//! -1 for attached segments, they have no semaphore of ours
+	int owner;	//! created by this process, RobbusShm_Delete() removes it
 } RobbusShmRecord_t;
 
-#define MEMORY_TYPE_COUNT 3
+#define MEMORY_TYPE_COUNT 7
 #define MEMORY_INPUT_KEY ftok("/etc/robbus",'I')
 #define MEMORY_OUTPUT_KEY ftok("/etc/robbus",'O')
 #define MEMORY_GPS_KEY ftok("/etc/robbus",'G')
+#define MEMORY_CONTROL_KEY ftok("/etc/robbus",'C')
+#define MEMORY_STATS_KEY ftok("/etc/robbus",'S')
+#define MEMORY_COMMAND_KEY ftok("/etc/robbus",'Q')
+#define MEMORY_SNAPSHOT_KEY ftok("/etc/robbus",'P')
 
 RobbusShmRecord_t g_memoryList[MEMORY_TYPE_COUNT];
 
@@ -82,6 +93,7 @@ int createMemoryType(RobbusShm_MemoryType_t index, int key, int size) {
 	union semun sem_val; /* semaphore value, for semctl(). */
 
 	g_memoryList[index].key = key;
+	g_memoryList[index].owner = 1;
 	
 	/* create a semaphore set with one semaphore */
 	/* in it, with access only to the owner. */
@@ -120,10 +132,17 @@ int createMemoryType(RobbusShm_MemoryType_t index, int key, int size) {
 int deleteMemoryType(RobbusShm_MemoryType_t index) {
 	struct shmid_ds shm_desc;
 
+	if (g_memoryList[index].memPtr == NULL)
+		return 0; // neither created nor attached by this process
+
 	/* detach the shared memory segment from our process's address space. */
 	if (shmdt(g_memoryList[index].memPtr) == -1) {
 		perror("main: shmdt: ");
 	}
+	g_memoryList[index].memPtr = NULL;
+	if (!g_memoryList[index].owner)
+		return 0; // attached only, its creator still uses it
+	g_memoryList[index].owner = 0;
 
 	/* de-allocate the shared memory segment. */
 	if (shmctl(g_memoryList[index].memHandle, IPC_RMID, &shm_desc) == -1) {
@@ -144,6 +163,7 @@ int RobbusShm_Create(size_t inDataSize, size_t outDataSize, size_t gpsDataSize)
 	createMemoryType(ROBBUS_SHM_INPUT_DATA, MEMORY_INPUT_KEY, inDataSize);
 	createMemoryType(ROBBUS_SHM_OUTPUT_DATA, MEMORY_OUTPUT_KEY, outDataSize);
 	createMemoryType(ROBBUS_SHM_GPS_DATA, MEMORY_GPS_KEY, gpsDataSize);
+	// control segment belongs to robbus_sync, it is attached on first use
 	return 0;
 }
 
@@ -153,9 +173,82 @@ int RobbusShm_Delete(void) {
 	deleteMemoryType(ROBBUS_SHM_INPUT_DATA);
 	deleteMemoryType(ROBBUS_SHM_OUTPUT_DATA);
 	deleteMemoryType(ROBBUS_SHM_GPS_DATA);
+	deleteMemoryType(ROBBUS_SHM_CONTROL);
+	deleteMemoryType(ROBBUS_SHM_STATS);
+	deleteMemoryType(ROBBUS_SHM_COMMAND);
+	deleteMemoryType(ROBBUS_SHM_SNAPSHOT);
 	return 0;
 }
 
+static int RobbusShm_GetKey(RobbusShm_MemoryType_t memType) {
+	switch (memType) {
+		case ROBBUS_SHM_INPUT_DATA:
+			return MEMORY_INPUT_KEY;
+		case ROBBUS_SHM_OUTPUT_DATA:
+			return MEMORY_OUTPUT_KEY;
+		case ROBBUS_SHM_GPS_DATA:
+			return MEMORY_GPS_KEY;
+		case ROBBUS_SHM_CONTROL:
+			return MEMORY_CONTROL_KEY;
+		case ROBBUS_SHM_COMMAND:
+			return MEMORY_COMMAND_KEY;
+		case ROBBUS_SHM_SNAPSHOT:
+			return MEMORY_SNAPSHOT_KEY;
+		default:
+			return MEMORY_STATS_KEY;
+	}
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief create segment sized by its owner, i.e. robbus_sync
+*
+* Segment of another size left by a previous run is removed first,
+* readers still attached to it keep it until they detach.
+*
+* \return pointer to the zeroed segment, NULL on failure
+*/
+void* RobbusShm_CreateSegment(RobbusShm_MemoryType_t memType, size_t size) {
+	int key = RobbusShm_GetKey(memType);
+	int handle = shmget(key, 0, 0600);
+
+	if (handle != -1) {
+		struct shmid_ds desc;
+		if (shmctl(handle, IPC_STAT, &desc) == 0 && desc.shm_segsz != size)
+			shmctl(handle, IPC_RMID, NULL);
+	}
+	if (createMemoryType(memType, key, size) != 0)
+		return NULL;
+	memset(g_memoryList[memType].memPtr, 0, size);
+	return g_memoryList[memType].memPtr;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief attach segment created by another process, whatever its size
+*
+* RobbusShm_Delete() only detaches it and the semaphore is not used.
+*
+* \return pointer to the segment, NULL if it does not exist
+*/
+void* RobbusShm_Attach(RobbusShm_MemoryType_t memType) {
+	void *ptr;
+	int handle = shmget(RobbusShm_GetKey(memType), 0, 0600);
+
+	if (handle == -1)
+		return NULL;
+	ptr = shmat(handle, NULL, 0);
+	if (ptr == (void*)-1) {
+		perror("Attaching shared memory failed");
+		return NULL;
+	}
+	g_memoryList[memType].memHandle = handle;
+	g_memoryList[memType].memPtr = ptr;
+	g_memoryList[memType].semHandle = -1;
+	g_memoryList[memType].owner = 0;
+	return ptr;
+}
+
 void* RobbusShm_GetPtr(RobbusShm_MemoryType_t memType) {
 	return g_memoryList[memType].memPtr;
 }
@@ -181,6 +274,190 @@ int RobbusShm_Write(RobbusShm_MemoryType_t memType, void* buffer, size_t offset,
 	}
 	memcpy(g_memoryList[memType].memPtr + offset, buffer, size);
 	RobbusShm_Unlock(memType);
+	if (memType == ROBBUS_SHM_INPUT_DATA)
+		RobbusShm_NotifyInput();
 	return 0;
 }
 
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief start writing node slot in place, without the semaphore
+*
+* Marks the slot as being written and moves its sequence, the single
+* writer then fills the payload in place (e.g. copies a checked reply).
+*
+* \param offset offset of the node slot (its state byte)
+* \return pointer to the slot payload
+*/
+uint8_t* RobbusShm_BeginSlotWrite(RobbusShm_MemoryType_t memType, size_t offset) {
+	uint8_t *state = (uint8_t*)g_memoryList[memType].memPtr + offset;
+	uint8_t current = __atomic_load_n(state, __ATOMIC_RELAXED);
+
+	__atomic_store_n(state, ((current & ~(ROBBUS_SHM_SLOT_WRITING|ROBBUS_SHM_SLOT_VALID)) + ROBBUS_SHM_SLOT_SEQUENCE_STEP)
+		| ROBBUS_SHM_SLOT_WRITING, __ATOMIC_RELAXED);
+	// payload stores must not become visible before the writing flag
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return state + 1;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief publish slot written after RobbusShm_BeginSlotWrite()
+*
+* \param valid nonzero if the payload is complete and good
+*/
+void RobbusShm_EndSlotWrite(RobbusShm_MemoryType_t memType, size_t offset, int valid) {
+	uint8_t *state = (uint8_t*)g_memoryList[memType].memPtr + offset;
+	uint8_t current = __atomic_load_n(state, __ATOMIC_RELAXED) & ~ROBBUS_SHM_SLOT_WRITING;
+
+	__atomic_store_n(state, valid ? current | ROBBUS_SHM_SLOT_VALID : current, __ATOMIC_RELEASE);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief copy consistent payload of a slot published by RobbusShm_EndSlotWrite()
+*
+* Retries while the slot is being written or changed during the copy.
+*
+* \param offset offset of the node slot (its state byte)
+* \param size payload size
+* \return 1 if the payload is valid, 0 otherwise
+*/
+int RobbusShm_ReadSlot(RobbusShm_MemoryType_t memType, void* buffer, size_t offset, size_t size) {
+	uint8_t *state = (uint8_t*)g_memoryList[memType].memPtr + offset;
+	uint8_t before, after;
+
+	for (;;) {
+		before = __atomic_load_n(state, __ATOMIC_ACQUIRE);
+		if (before & ROBBUS_SHM_SLOT_WRITING) {
+			sched_yield(); // writer copies the payload, takes a moment
+			continue;
+		}
+		memcpy(buffer, state + 1, size);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(state, __ATOMIC_RELAXED);
+		if (before == after)
+			return (before & ROBBUS_SHM_SLOT_VALID) != 0;
+	}
+}
+
+/// attached on first use, NULL while robbus_sync has not created it
+static RobbusShm_Control_t *RobbusShm_GetControl(void) {
+	if (g_memoryList[ROBBUS_SHM_CONTROL].memPtr == NULL)
+		RobbusShm_Attach(ROBBUS_SHM_CONTROL);
+	return g_memoryList[ROBBUS_SHM_CONTROL].memPtr;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief wake threads waiting for new input
+*
+* The syscall is left out when nobody waits.
+*/
+void RobbusShm_NotifyInput(void) {
+	RobbusShm_Control_t *control = RobbusShm_GetControl();
+
+	if (control == NULL)
+		return; // no robbus_sync to wake
+
+	__atomic_add_fetch(&control->inputSequence, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&control->waiters, __ATOMIC_SEQ_CST) != 0)
+		syscall(SYS_futex, &control->inputSequence, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+uint32_t RobbusShm_GetInputSequence(void) {
+	RobbusShm_Control_t *control = RobbusShm_GetControl();
+
+	return control != NULL ? __atomic_load_n(&control->inputSequence, __ATOMIC_ACQUIRE) : 0;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief wait until input is notified after sequence was read
+*
+* \param sequence RobbusShm_GetInputSequence() taken before checking the input
+* \param deadlineUs CLOCK_MONOTONIC time in us to give up at
+* \return 0 when notified, ETIMEDOUT when the deadline passed
+*/
+int RobbusShm_WaitInput(uint32_t sequence, unsigned long long deadlineUs) {
+	RobbusShm_Control_t *control = RobbusShm_GetControl();
+	struct timespec deadline;
+	int ret = 0;
+
+	deadline.tv_sec = deadlineUs / 1000000ULL;
+	deadline.tv_nsec = (deadlineUs % 1000000ULL) * 1000;
+
+	// waiters are counted first, so the notifier either sees them or the
+	// futex sees the new sequence
+	__atomic_add_fetch(&control->waiters, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&control->inputSequence, __ATOMIC_SEQ_CST) == sequence) {
+		// absolute CLOCK_MONOTONIC timeout
+		if (syscall(SYS_futex, &control->inputSequence, FUTEX_WAIT_BITSET, sequence,
+			&deadline, NULL, FUTEX_BITSET_MATCH_ANY) == -1 && errno == ETIMEDOUT) {
+			ret = ETIMEDOUT;
+			break;
+		}
+	}
+	__atomic_sub_fetch(&control->waiters, 1, __ATOMIC_SEQ_CST);
+	return ret;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief replace node layout and move its generation, single writer only
+*
+* \param count at most ROBBUS_SHM_LAYOUT_MAX_NODES
+*/
+void RobbusShm_PublishLayout(const RobbusShm_LayoutNode_t *nodes, uint32_t count) {
+	RobbusShm_Control_t *control = RobbusShm_GetControl();
+	uint32_t generation = __atomic_load_n(&control->layoutGeneration, __ATOMIC_RELAXED);
+
+	// odd generation tells readers to retry, as with slot sequences
+	__atomic_store_n(&control->layoutGeneration, generation | 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(control->layout, nodes, count * sizeof(RobbusShm_LayoutNode_t));
+	control->layoutNodeCount = count;
+	__atomic_store_n(&control->layoutGeneration, (generation | 1) + 1, __ATOMIC_RELEASE);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief copy consistent node layout
+*
+* \param nodes room for ROBBUS_SHM_LAYOUT_MAX_NODES nodes
+* \return layout generation, 0 if none was published yet or robbus_sync does not run
+*/
+uint32_t RobbusShm_ReadLayout(RobbusShm_LayoutNode_t *nodes, uint32_t *count) {
+	RobbusShm_Control_t *control = RobbusShm_GetControl();
+	uint32_t before, after;
+
+	*count = 0;
+	if (control == NULL)
+		return 0;
+	for (;;) {
+		before = __atomic_load_n(&control->layoutGeneration, __ATOMIC_ACQUIRE);
+		if (before & 1) {
+			sched_yield();
+			continue;
+		}
+		*count = control->layoutNodeCount;
+		if (*count > ROBBUS_SHM_LAYOUT_MAX_NODES)
+			*count = ROBBUS_SHM_LAYOUT_MAX_NODES; // torn, checked below
+		memcpy(nodes, control->layout, *count * sizeof(RobbusShm_LayoutNode_t));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&control->layoutGeneration, __ATOMIC_RELAXED);
+		if (before == after)
+			return before;
+	}
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief generation of the node layout, readers compare it to the one they read
+*/
+uint32_t RobbusShm_GetLayoutGeneration(void) {
+	RobbusShm_Control_t *control = RobbusShm_GetControl();
+
+	return control != NULL ? __atomic_load_n(&control->layoutGeneration, __ATOMIC_ACQUIRE) : 0;
+}
@@ -18,14 +18,62 @@
 typedef enum {
 	ROBBUS_SHM_INPUT_DATA = 0,
 	ROBBUS_SHM_OUTPUT_DATA = 1,
-	ROBBUS_SHM_GPS_DATA = 2
+	ROBBUS_SHM_GPS_DATA = 2,
+	ROBBUS_SHM_CONTROL = 3,	//! RobbusShm_Control_t
+	ROBBUS_SHM_STATS = 4,	//! RobbusStats_Header_t, created by RobbusShm_CreateSegment()
+	ROBBUS_SHM_COMMAND = 5,	//! RobbusCommand_Queue_t
+	ROBBUS_SHM_SNAPSHOT = 6	//! RobbusSnapshot_Header_t
 } RobbusShm_MemoryType_t;
+
+#define ROBBUS_SHM_LAYOUT_MAX_NODES 128
+
+/// node slots as robbus_sync uses them, they may differ from the config order after reload
+typedef struct {
+	uint32_t	address;
+	uint32_t	removed;	//! slot of a node removed by reload, not synced
+	uint32_t	bus;		//! index of the bus thread syncing the node (and of its command ring)
+	uint32_t	inDataOffset;
+	uint32_t	inDataSize;
+	uint32_t	outDataOffset;
+	uint32_t	outDataSize;
+} RobbusShm_LayoutNode_t;
+
+/// shared between robbus_sync and the processes feeding it
+typedef struct {
+	uint32_t	inputSequence;	//! futex word, moved whenever node input is marked valid
+	uint32_t	waiters;	//! threads blocked on inputSequence
+	uint32_t	layoutGeneration; //! odd while the layout changes, 0 before it is published
+	uint32_t	layoutNodeCount;
+	RobbusShm_LayoutNode_t layout[ROBBUS_SHM_LAYOUT_MAX_NODES];
+} RobbusShm_Control_t;
 int RobbusShm_Lock(RobbusShm_MemoryType_t memType);
 int RobbusShm_Unlock(RobbusShm_MemoryType_t memType);
 int RobbusShm_Create(size_t inDataSize, size_t outDataSize, size_t gpsDataSize);
 int RobbusShm_Delete(void);
+void* RobbusShm_CreateSegment(RobbusShm_MemoryType_t memType, size_t size);
+void* RobbusShm_Attach(RobbusShm_MemoryType_t memType);
 void* RobbusShm_GetPtr(RobbusShm_MemoryType_t memType); 
 int RobbusShm_Read(RobbusShm_MemoryType_t memType, void* buffer, size_t offset, size_t size);
 int RobbusShm_Write(RobbusShm_MemoryType_t memType, void* buffer, size_t offset, size_t size);
 
+// state byte of a slot published without locking (first byte of the node slot),
+// valid bit matches the plain valid flag, so locked slots can be read the same way
+#define ROBBUS_SHM_SLOT_VALID		0x01	//! payload holds the last good reply
+#define ROBBUS_SHM_SLOT_WRITING		0x02	//! payload is being written, readers retry
+#define ROBBUS_SHM_SLOT_SEQUENCE_STEP	0x04	//! bits 7:2 count writes, so readers see any change
+
+uint8_t* RobbusShm_BeginSlotWrite(RobbusShm_MemoryType_t memType, size_t offset);
+void RobbusShm_EndSlotWrite(RobbusShm_MemoryType_t memType, size_t offset, int valid);
+int RobbusShm_ReadSlot(RobbusShm_MemoryType_t memType, void* buffer, size_t offset, size_t size);
+
+// RobbusShm_Write() of input notifies by itself, writers going through
+// RobbusShm_GetPtr() call RobbusShm_NotifyInput() after unlocking
+void RobbusShm_NotifyInput(void);
+uint32_t RobbusShm_GetInputSequence(void);
+int RobbusShm_WaitInput(uint32_t sequence, unsigned long long deadlineUs);
+
+void RobbusShm_PublishLayout(const RobbusShm_LayoutNode_t *nodes, uint32_t count);
+uint32_t RobbusShm_ReadLayout(RobbusShm_LayoutNode_t *nodes, uint32_t *count);
+uint32_t RobbusShm_GetLayoutGeneration(void);
+
 #endif
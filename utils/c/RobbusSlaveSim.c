@@ -0,0 +1,152 @@
+/*!
+* \file RobbusSlaveSim.c
+* \brief host build of the node state machine from avr/test_v3
+*
+* The firmware source is compiled unchanged against the replacement AVR
+* headers in avrsim/, received bytes are passed to the receive interrupt
+* routine and the transmit interrupt is called until the reply is out.
+* A running slot timer expires right after the received byte, so group
+* read replies come back at once instead of in their time slot.
+* There is only one state machine, callers have to serialize access.
+* State kept between packets (change only sequences, bulk transfer) is
+* swapped with the address, so every simulated node has its own.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#include "robbus.c"
+
+#include "RobbusSlaveSim.h"
+
+volatile uint16_t AvrSim_UDR;
+volatile uint8_t AvrSim_UCSRA, AvrSim_UCSRB, AvrSim_UBRRL, AvrSim_UBRRH;
+volatile uint8_t AvrSim_TCCR1B, AvrSim_TIMSK, AvrSim_TIFR;
+volatile uint16_t AvrSim_TCNT1, AvrSim_OCR1A;
+uint8_t AvrSim_Eeprom[AVRSIM_EEPROM_SIZE];
+
+/// addresses with their own node state, others share the one of address 0
+#define SIM_NODE_COUNT 0x80
+
+/// node state which lives longer than one packet
+typedef struct {
+#if ROBBUS_CHANGE_ONLY
+	uint8_t		lastInput[ROBBUS_INCOMMING_SIZE];
+	uint8_t		lastOutput[ROBBUS_OUTGOING_SIZE];
+	uint8_t		inputSequence;
+	uint8_t		outputSequence;
+#endif
+#if ROBBUS_BULK_BLOCK_SIZE
+	uint8_t		bulkData[1024];
+	uint16_t	bulkTotal;
+	uint8_t		bulkBlockSize;
+	uint16_t	bulkNext;
+	uint8_t		bulkWindow;
+#endif
+} SimNode_t;
+
+static uint8_t outData[ROBBUS_OUTGOING_SIZE];
+static SimNode_t simNodes[SIM_NODE_COUNT];
+static uint8_t simAddress;	//! node whose state is loaded in the machine
+
+static SimNode_t *getSimNode(uint8_t address) {
+	return &simNodes[address < SIM_NODE_COUNT ? address : 0];
+}
+
+static void saveSimNode(SimNode_t *node) {
+#if ROBBUS_CHANGE_ONLY
+	memcpy(node->lastInput, lastInput, sizeof(lastInput));
+	memcpy(node->lastOutput, lastOutput, sizeof(lastOutput));
+	node->inputSequence = inputSequence;
+	node->outputSequence = outputSequence;
+#endif
+#if ROBBUS_BULK_BLOCK_SIZE
+	node->bulkTotal = bulkTotal;
+	node->bulkBlockSize = bulkBlockSize;
+	node->bulkNext = bulkNext;
+	node->bulkWindow = bulkWindow;
+#endif
+}
+
+static void loadSimNode(SimNode_t *node) {
+#if ROBBUS_CHANGE_ONLY
+	memcpy(lastInput, node->lastInput, sizeof(lastInput));
+	memcpy(lastOutput, node->lastOutput, sizeof(lastOutput));
+	inputSequence = node->inputSequence;
+	outputSequence = node->outputSequence;
+#endif
+#if ROBBUS_BULK_BLOCK_SIZE
+	Robbus_SetBulkBuffer(node->bulkData, sizeof(node->bulkData));
+	bulkTotal = node->bulkTotal;
+	bulkBlockSize = node->bulkBlockSize;
+	bulkNext = node->bulkNext;
+	bulkWindow = node->bulkWindow;
+#endif
+}
+
+/// node application: reply with the complement of the received data
+static uint8_t* messageHandler(uint8_t *inData) {
+	uint8_t i;
+	for (i = 0; i < ROBBUS_OUTGOING_SIZE; i++)
+		outData[i] = ~inData[i < ROBBUS_INCOMMING_SIZE ? i : 0];
+	return outData;
+}
+
+void RobbusSlaveSim_Init(void) {
+	int i;
+
+	Robbus_Init(messageHandler);
+	// every node starts from the reset state
+	for (i = 0; i < SIM_NODE_COUNT; i++)
+		saveSimNode(&simNodes[i]);
+	simAddress = deviceAddress;
+	loadSimNode(getSimNode(simAddress));
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief change address the node answers to
+*
+* Takes effect for the next packet, so a single state machine can
+* stand for every node on the bus. State of the previous node is saved
+* and the one of the new node loaded.
+*/
+void RobbusSlaveSim_SetAddress(uint8_t address) {
+	if (getSimNode(address) != getSimNode(simAddress)) {
+		saveSimNode(getSimNode(simAddress));
+		loadSimNode(getSimNode(address));
+	}
+	simAddress = address;
+	deviceAddress = address;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief pass one bus byte to the node
+*
+* \param c received byte
+* \param reply where to store bytes the node transmits in response
+* (at least ROBBUS_SLAVE_SIM_REPLY_MAX)
+* \return number of reply bytes
+*/
+size_t RobbusSlaveSim_Feed(uint8_t c, uint8_t *reply) {
+	size_t length = 0;
+
+	AvrSim_UDR = AVRSIM_UDR_EMPTY | c;
+	AvrSim_UsartRxInterrupt();
+#if ROBBUS_GROUP_READ
+	if (AvrSim_TIMSK & _BV(OCIE1A))
+		AvrSim_Timer1CompareInterrupt();
+#endif
+	while (AvrSim_UDR < AVRSIM_UDR_EMPTY && length < ROBBUS_SLAVE_SIM_REPLY_MAX) {
+		reply[length++] = AvrSim_UDR;
+
+		// byte transmitted, the interrupt pushes the next one
+		AvrSim_UDR = AVRSIM_UDR_EMPTY;
+		AvrSim_UsartTxInterrupt();
+	}
+	return length;
+}
@@ -0,0 +1,25 @@
+/*!
+* \file RobbusSlaveSim.h
+* \brief host build of the node state machine from avr/test_v3
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#ifndef ROBBUS_SLAVE_SIM_H
+#define ROBBUS_SLAVE_SIM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/// longest reply the simulated node produces (wrapped)
+#define ROBBUS_SLAVE_SIM_REPLY_MAX 64
+
+void RobbusSlaveSim_Init(void);
+void RobbusSlaveSim_SetAddress(uint8_t address);
+size_t RobbusSlaveSim_Feed(uint8_t c, uint8_t *reply);
+
+#endif
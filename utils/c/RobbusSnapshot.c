@@ -0,0 +1,121 @@
+/*!
+* \file RobbusSnapshot.c
+* \brief output of whole sync rounds for readers which must not block robbus_sync
+*
+* The writer fills the buffer after the latest one, so a reader copying
+* the latest has a whole round before it is overwritten. Reader slower
+* than that notices by the buffer epoch and takes the new latest one.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "RobbusSnapshot.h"
+#include "RobbusShm.h"
+
+/// buffers start at cache lines
+#define SNAPSHOT_ALIGN 64
+
+static RobbusSnapshot_Bus_t *RobbusSnapshot_GetBus(RobbusSnapshot_Header_t *snapshot, int bus) {
+	return (RobbusSnapshot_Bus_t*)((uint8_t*)snapshot + SNAPSHOT_ALIGN) + bus;
+}
+
+static uint8_t *RobbusSnapshot_GetBuffer(RobbusSnapshot_Header_t *snapshot, int bus, int index) {
+	return (uint8_t*)RobbusSnapshot_GetBus(snapshot, snapshot->busCount)
+		+ (bus * ROBBUS_SNAPSHOT_BUFFERS + index) * (size_t)snapshot->stride;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief create snapshot segment with no round published yet
+*
+* \param size output memory size
+* \return segment or NULL on failure
+*/
+RobbusSnapshot_Header_t *RobbusSnapshot_Create(int busCount, size_t size) {
+	size_t stride = (size + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+	RobbusSnapshot_Header_t *snapshot = RobbusShm_CreateSegment(ROBBUS_SHM_SNAPSHOT,
+		SNAPSHOT_ALIGN + busCount * (sizeof(RobbusSnapshot_Bus_t) + ROBBUS_SNAPSHOT_BUFFERS * stride));
+
+	if (snapshot == NULL)
+		return NULL;
+	snapshot->busCount = busCount;
+	snapshot->size = size;
+	snapshot->stride = stride;
+	__atomic_store_n(&snapshot->magic, ROBBUS_SNAPSHOT_MAGIC, __ATOMIC_RELEASE);
+	return snapshot;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief attach snapshot segment of a running robbus_sync
+*
+* \return segment or NULL if there is none
+*/
+RobbusSnapshot_Header_t *RobbusSnapshot_Attach(void) {
+	RobbusSnapshot_Header_t *snapshot = RobbusShm_Attach(ROBBUS_SHM_SNAPSHOT);
+
+	if (snapshot == NULL || __atomic_load_n(&snapshot->magic, __ATOMIC_ACQUIRE) != ROBBUS_SNAPSHOT_MAGIC)
+		return NULL;
+	return snapshot;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief publish output of a finished round, by the bus thread only
+*
+* \param data whole output memory layout, snapshot size bytes
+*/
+void RobbusSnapshot_Publish(RobbusSnapshot_Header_t *snapshot, int bus, const void *data) {
+	RobbusSnapshot_Bus_t *record = RobbusSnapshot_GetBus(snapshot, bus);
+	uint64_t latest = __atomic_load_n(&record->latest, __ATOMIC_RELAXED);
+	uint64_t epoch = (latest >> 2) + 1;
+	int index = latest ? ((latest & 3) + 1) % ROBBUS_SNAPSHOT_BUFFERS : 0;
+
+	// readers still copying the buffer see the epoch change
+	__atomic_store_n(&record->epochs[index], 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(RobbusSnapshot_GetBuffer(snapshot, bus, index), data, snapshot->size);
+	__atomic_store_n(&record->epochs[index], epoch, __ATOMIC_RELEASE);
+	__atomic_store_n(&record->latest, epoch << 2 | index, __ATOMIC_RELEASE);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief round of the latest snapshot, readers poll it for a new one
+*
+* \return round number, 0 before the first
+*/
+uint64_t RobbusSnapshot_GetEpoch(RobbusSnapshot_Header_t *snapshot, int bus) {
+	return __atomic_load_n(&RobbusSnapshot_GetBus(snapshot, bus)->latest, __ATOMIC_ACQUIRE) >> 2;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief copy the latest complete round of a bus
+*
+* \param buffer room for snapshot size bytes
+* \return round number of the copy, 0 if none was published yet (buffer untouched)
+*/
+uint64_t RobbusSnapshot_Read(RobbusSnapshot_Header_t *snapshot, int bus, void *buffer) {
+	RobbusSnapshot_Bus_t *record = RobbusSnapshot_GetBus(snapshot, bus);
+
+	for (;;) {
+		uint64_t latest = __atomic_load_n(&record->latest, __ATOMIC_ACQUIRE);
+		int index = latest & 3;
+
+		if (latest == 0)
+			return 0;
+		memcpy(buffer, RobbusSnapshot_GetBuffer(snapshot, bus, index), snapshot->size);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&record->epochs[index], __ATOMIC_RELAXED) == latest >> 2)
+			return latest >> 2;
+	}
+}
@@ -0,0 +1,47 @@
+/*!
+* \file RobbusSnapshot.h
+* \brief output of whole sync rounds for readers which must not block robbus_sync
+*
+* Each bus thread publishes its local output copy after every round into
+* one of three buffers, the latest complete round is found by a single
+* load. A snapshot holds the whole output memory layout, slots of nodes
+* synced by other buses are left zero.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#ifndef ROBBUS_SNAPSHOT_H
+#define ROBBUS_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ROBBUS_SNAPSHOT_MAGIC 0x50534252UL	// "RBSP"
+#define ROBBUS_SNAPSHOT_BUFFERS 3
+
+/// publication state of one bus
+typedef struct {
+	uint64_t	latest;		//! epoch << 2 | buffer of the latest complete round, 0 before the first
+	uint64_t	epochs[ROBBUS_SNAPSHOT_BUFFERS];	//! round held by each buffer, 0 while it is written
+	uint64_t	padding[4];	//! keeps buses on their own cache line
+} RobbusSnapshot_Bus_t;
+
+/// segment start, followed by bus records and their buffers
+typedef struct {
+	uint32_t	magic;
+	uint32_t	busCount;
+	uint32_t	size;		//! output memory size, bytes of each snapshot
+	uint32_t	stride;		//! distance of buffers
+} RobbusSnapshot_Header_t;
+
+RobbusSnapshot_Header_t *RobbusSnapshot_Create(int busCount, size_t size);
+RobbusSnapshot_Header_t *RobbusSnapshot_Attach(void);
+void RobbusSnapshot_Publish(RobbusSnapshot_Header_t *snapshot, int bus, const void *data);
+uint64_t RobbusSnapshot_GetEpoch(RobbusSnapshot_Header_t *snapshot, int bus);
+uint64_t RobbusSnapshot_Read(RobbusSnapshot_Header_t *snapshot, int bus, void *buffer);
+
+#endif
@@ -0,0 +1,189 @@
+/*!
+* \file RobbusStats.c
+* \brief transaction and cycle time histograms in a shared memory segment
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "RobbusStats.h"
+#include "RobbusShm.h"
+
+#define SUB_BUCKETS (1 << ROBBUS_STATS_SUB_BITS)
+
+static size_t RobbusStats_GetSize(int busCount, int nodeCount) {
+	return sizeof(RobbusStats_Header_t) + busCount * sizeof(RobbusStats_Bus_t)
+		+ nodeCount * sizeof(RobbusStats_Node_t);
+}
+
+/// bucket of a value, exact below SUB_BUCKETS
+static unsigned RobbusStats_GetBucket(unsigned long long value) {
+	unsigned shift;
+
+	if (value < SUB_BUCKETS)
+		return value;
+	if (value >> ROBBUS_STATS_MAX_BITS)
+		return ROBBUS_STATS_BUCKETS - 1;
+	shift = 63 - __builtin_clzll(value) - ROBBUS_STATS_SUB_BITS;
+	return shift * SUB_BUCKETS + (value >> shift);
+}
+
+/// highest value falling into a bucket
+static unsigned long long RobbusStats_GetBucketTop(unsigned bucket) {
+	unsigned shift;
+
+	if (bucket < SUB_BUCKETS)
+		return bucket;
+	shift = bucket / SUB_BUCKETS - 1;
+	return ((unsigned long long)(bucket % SUB_BUCKETS + SUB_BUCKETS + 1) << shift) - 1;
+}
+
+/// single writer update readers in other processes see whole
+static void RobbusStats_Add(uint64_t *counter, uint64_t value) {
+	__atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief create stats segment for given buses and room for node records
+*
+* Records are zeroed, the caller fills bus names and adds nodes.
+*
+* \return segment or NULL on failure
+*/
+RobbusStats_Header_t *RobbusStats_Create(int busCount, int nodeCapacity) {
+	RobbusStats_Header_t *stats = RobbusShm_CreateSegment(ROBBUS_SHM_STATS, RobbusStats_GetSize(busCount, nodeCapacity));
+
+	if (stats == NULL)
+		return NULL;
+	stats->busCount = busCount;
+	stats->nodeCapacity = nodeCapacity;
+	__atomic_store_n(&stats->magic, ROBBUS_STATS_MAGIC, __ATOMIC_RELEASE);
+	return stats;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief attach stats segment of a running robbus_sync
+*
+* \return segment or NULL if there is none
+*/
+RobbusStats_Header_t *RobbusStats_Attach(void) {
+	RobbusStats_Header_t *stats = RobbusShm_Attach(ROBBUS_SHM_STATS);
+
+	if (stats == NULL || __atomic_load_n(&stats->magic, __ATOMIC_ACQUIRE) != ROBBUS_STATS_MAGIC)
+		return NULL;
+	return stats;
+}
+
+RobbusStats_Bus_t *RobbusStats_GetBus(RobbusStats_Header_t *stats, int index) {
+	return (RobbusStats_Bus_t*)(stats + 1) + index;
+}
+
+RobbusStats_Node_t *RobbusStats_GetNode(RobbusStats_Header_t *stats, int index) {
+	return (RobbusStats_Node_t*)((RobbusStats_Bus_t*)(stats + 1) + stats->busCount) + index;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief take next node record, readers see it once it is filled
+*
+* \return record or NULL when the segment is full
+*/
+RobbusStats_Node_t *RobbusStats_AddNode(RobbusStats_Header_t *stats, int address, int bus) {
+	RobbusStats_Node_t *node;
+
+	if (stats->nodeCount >= stats->nodeCapacity)
+		return NULL;
+	node = RobbusStats_GetNode(stats, stats->nodeCount);
+	node->address = address;
+	node->bus = bus;
+	__atomic_store_n(&stats->nodeCount, stats->nodeCount + 1, __ATOMIC_RELEASE);
+	return node;
+}
+
+/// record added before for the node, NULL if there is none
+RobbusStats_Node_t *RobbusStats_FindNode(RobbusStats_Header_t *stats, int address, int bus) {
+	unsigned i;
+
+	for (i = 0; i < stats->nodeCount; i++) {
+		RobbusStats_Node_t *node = RobbusStats_GetNode(stats, i);
+		if (node->address == address && node->bus == bus)
+			return node;
+	}
+	return NULL;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief add value to histogram, only by the writer owning it
+*/
+void RobbusStats_Record(RobbusStats_Histogram_t *histogram, unsigned long long valueUs) {
+	RobbusStats_Add(&histogram->buckets[RobbusStats_GetBucket(valueUs)], 1);
+	RobbusStats_Add(&histogram->sumUs, valueUs);
+	if (valueUs > histogram->maxUs)
+		__atomic_store_n(&histogram->maxUs, valueUs, __ATOMIC_RELAXED);
+	RobbusStats_Add(&histogram->count, 1);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief count node transaction and its error if it failed
+*
+* \param result RBC_ code of the transaction
+*/
+void RobbusStats_CountTransaction(RobbusStats_Node_t *node, int result) {
+	RobbusStats_Add(&node->transactions, 1);
+	if (result < 0 && -result < ROBBUS_STATS_ERROR_CODES)
+		RobbusStats_Add(&node->errors[-result], 1);
+}
+
+void RobbusStats_SetHealth(RobbusStats_Node_t *node, int health) {
+	__atomic_store_n(&node->health, health, __ATOMIC_RELAXED);
+}
+
+void RobbusStats_CountProbe(RobbusStats_Node_t *node) {
+	RobbusStats_Add(&node->probes, 1);
+}
+
+void RobbusStats_SetLastReply(RobbusStats_Node_t *node, unsigned long long timeUs) {
+	__atomic_store_n(&node->lastReplyUs, timeUs, __ATOMIC_RELAXED);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief value not exceeded by given percentage of the recorded ones
+*
+* \return highest value of the bucket reached, 0 for empty histogram
+*/
+unsigned long long RobbusStats_GetPercentile(const RobbusStats_Histogram_t *histogram, double percent) {
+	uint64_t buckets[ROBBUS_STATS_BUCKETS], total = 0, seen = 0, target;
+	unsigned long long top;
+	int i;
+
+	// counts may move while read, work on one copy
+	for (i = 0; i < ROBBUS_STATS_BUCKETS; i++) {
+		buckets[i] = __atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED);
+		total += buckets[i];
+	}
+	if (total == 0)
+		return 0;
+	target = total * percent / 100.0 + 0.5;
+	if (target == 0)
+		target = 1;
+	for (i = 0; i < ROBBUS_STATS_BUCKETS - 1; i++) {
+		seen += buckets[i];
+		if (seen >= target)
+			break;
+	}
+	top = RobbusStats_GetBucketTop(i);
+	// no value is above the maximum
+	return top < histogram->maxUs ? top : __atomic_load_n(&histogram->maxUs, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,82 @@
+/*!
+* \file RobbusStats.h
+* \brief transaction and cycle time histograms in a shared memory segment
+*
+* Histograms are log-linear (HDR like): exact below 16 us, then 16 buckets
+* per power of two, i.e. values within 1/16 of their bucket. Each bus thread
+* is the only writer of its records, readers take them without locking.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#ifndef ROBBUS_STATS_H
+#define ROBBUS_STATS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ROBBUS_STATS_MAGIC 0x54534252UL	// "RBST"
+#define ROBBUS_STATS_SUB_BITS 4
+/// values up to 2^24 us (16 s), longer ones go to the last bucket
+#define ROBBUS_STATS_MAX_BITS 24
+#define ROBBUS_STATS_BUCKETS ((ROBBUS_STATS_MAX_BITS - ROBBUS_STATS_SUB_BITS + 1) << ROBBUS_STATS_SUB_BITS)
+/// errors are counted by their RBC_ code, errors[-code]
+#define ROBBUS_STATS_ERROR_CODES 9
+#define ROBBUS_STATS_NAME_SIZE 64
+
+/// node health, synced nodes are online even when their output is old
+#define ROBBUS_STATS_ONLINE	0
+#define ROBBUS_STATS_SUSPECT	1	//! stopped replying, only probed now
+#define ROBBUS_STATS_OFFLINE	2	//! probes failed at the longest interval
+
+typedef struct {
+	uint64_t	count;
+	uint64_t	sumUs;
+	uint64_t	maxUs;
+	uint64_t	buckets[ROBBUS_STATS_BUCKETS];
+} RobbusStats_Histogram_t;
+
+typedef struct {
+	char		name[ROBBUS_STATS_NAME_SIZE];	//! bus device
+	RobbusStats_Histogram_t cycle;	//! whole sync rounds
+} RobbusStats_Bus_t;
+
+typedef struct {
+	uint32_t	address;
+	uint32_t	bus;		//! index of the bus record
+	uint32_t	health;		//! ROBBUS_STATS_ONLINE, _SUSPECT or _OFFLINE
+	uint32_t	reserved;
+	uint64_t	lastReplyUs;	//! CLOCK_MONOTONIC time of the last good reply, 0 before any
+	uint64_t	probes;		//! echo packets sent while not online
+	uint64_t	transactions;
+	uint64_t	errors[ROBBUS_STATS_ERROR_CODES];
+	RobbusStats_Histogram_t firstByte;	//! request to the first reply byte
+	RobbusStats_Histogram_t transaction;	//! request to the reply checked
+} RobbusStats_Node_t;
+
+/// segment start, followed by bus and node records
+typedef struct {
+	uint32_t	magic;
+	uint32_t	busCount;
+	uint32_t	nodeCount;	//! records filled so far
+	uint32_t	nodeCapacity;
+} RobbusStats_Header_t;
+
+RobbusStats_Header_t *RobbusStats_Create(int busCount, int nodeCapacity);
+RobbusStats_Node_t *RobbusStats_AddNode(RobbusStats_Header_t *stats, int address, int bus);
+RobbusStats_Node_t *RobbusStats_FindNode(RobbusStats_Header_t *stats, int address, int bus);
+RobbusStats_Header_t *RobbusStats_Attach(void);
+RobbusStats_Bus_t *RobbusStats_GetBus(RobbusStats_Header_t *stats, int index);
+RobbusStats_Node_t *RobbusStats_GetNode(RobbusStats_Header_t *stats, int index);
+void RobbusStats_Record(RobbusStats_Histogram_t *histogram, unsigned long long valueUs);
+void RobbusStats_CountTransaction(RobbusStats_Node_t *node, int result);
+void RobbusStats_SetHealth(RobbusStats_Node_t *node, int health);
+void RobbusStats_CountProbe(RobbusStats_Node_t *node);
+void RobbusStats_SetLastReply(RobbusStats_Node_t *node, unsigned long long timeUs);
+unsigned long long RobbusStats_GetPercentile(const RobbusStats_Histogram_t *histogram, double percent);
+
+#endif
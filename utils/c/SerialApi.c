@@ -0,0 +1,220 @@
+/*!
+* \file SerialApi.c
+* \brief transport independent part of the serial port interface
+*
+* Selects the backend by the device name prefix and keeps the receive
+* ring, so the backends only move bytes:
+*   tty:/dev/ttyS0 (or just /dev/ttyS0) - serial port
+*   pty:[link]                          - pseudo terminal, slave side is printed or linked
+*   loop:LOW-HIGH                       - in-process bus with simulated nodes
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#include <string.h>
+
+#include "SerialApi.h"
+#include "SerialApiBackend.h"
+
+static const SerialApi_Backend_t *m_backends[] = {
+	&SerialApi_TtyBackend,
+	&SerialApi_PtyBackend,
+	&SerialApi_LoopbackBackend,
+};
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief open port using backend selected by device name prefix
+*
+* \param deviceName port device, names without known prefix are ttys
+* \param baudRate bus speed
+* \return port handle or NULL on failure
+*/
+SerialApi_t *SerialApi_Open(const char *deviceName, unsigned long baudRate) {
+	size_t i;
+
+	for (i = 0; i < sizeof(m_backends)/sizeof(m_backends[0]); i++) {
+		size_t length = strlen(m_backends[i]->prefix);
+		if (strncmp(deviceName, m_backends[i]->prefix, length) == 0)
+			return m_backends[i]->open(deviceName + length, baudRate);
+	}
+	return SerialApi_TtyBackend.open(deviceName, baudRate);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief initialize common part of the port, called by backends
+*/
+void SerialApi_InitPort(SerialApi_t *port, const SerialApi_Backend_t *backend, unsigned long baudRate) {
+	port->backend = backend;
+	port->baudRate = baudRate;
+	port->rxHead = 0;
+	port->rxTail = 0;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* Destructor
+*/
+int SerialApi_Close(SerialApi_t *port) {
+	return port->backend->close(port);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief send single byte
+*
+* \param a_toSend byte to send
+*/
+int SerialApi_SendByte(SerialApi_t *port, uint8_t c) {
+	return SerialApi_Send(port, &c, 1);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief send block of bytes by as few writes as possible
+*
+* \param data bytes to send
+* \param size number of bytes
+*/
+int SerialApi_Send(SerialApi_t *port, const uint8_t *data, size_t size) {
+	return port->backend->send(port, data, size);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief set absolute time when waiting for received data gives up
+*
+* \param deadline CLOCK_MONOTONIC time, NULL restores the default
+* inter-character timeout
+*/
+int SerialApi_SetDeadline(SerialApi_t *port, const struct timespec *deadline) {
+	return port->backend->setDeadline(port, deadline);
+}
+
+unsigned long SerialApi_GetBaudRate(SerialApi_t *port) {
+	return port->baudRate;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief append received bytes to the ring, used by in-process backends
+*
+* \return number of bytes stored (rest is dropped when the ring is full)
+*/
+size_t SerialApi_Store(SerialApi_t *port, const uint8_t *data, size_t size) {
+	size_t i, space = SERIAL_API_RX_RING_SIZE - (port->rxHead - port->rxTail);
+
+	if (size > space)
+		size = space;
+	for (i = 0; i < size; i++)
+		port->rxRing[(port->rxHead + i) & SERIAL_API_RX_RING_MASK] = data[i];
+	port->rxHead += size;
+	return size;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief fill the receive ring by a single backend call
+*
+* Asks for as much as fits into the contiguous free part of the ring.
+*
+* \return number of bytes read (0 on timeout)
+*/
+static int SerialApi_Fill(SerialApi_t *port) {
+	size_t offset = port->rxHead & SERIAL_API_RX_RING_MASK;
+	size_t space = SERIAL_API_RX_RING_SIZE - (port->rxHead - port->rxTail);
+	int ret;
+
+	if (space > SERIAL_API_RX_RING_SIZE - offset)
+		space = SERIAL_API_RX_RING_SIZE - offset;
+	if (space == 0)
+		return 0;
+
+	ret = port->backend->fill(port, port->rxRing + offset, space);
+	if (ret <= 0)
+		return 0;
+	port->rxHead += ret;
+	return ret;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief get contiguous block of received bytes without consuming them
+*
+* Waits for new data only if nothing is buffered.
+*
+* \param data set to the first buffered byte
+* \return number of bytes available at data (0 on timeout)
+*/
+int SerialApi_ReceiveChunk(SerialApi_t *port, const uint8_t **data) {
+	size_t offset, size;
+
+	if (port->rxHead == port->rxTail && SerialApi_Fill(port) == 0)
+		return 0;
+
+	offset = port->rxTail & SERIAL_API_RX_RING_MASK;
+	size = port->rxHead - port->rxTail;
+	if (size > SERIAL_API_RX_RING_SIZE - offset)
+		size = SERIAL_API_RX_RING_SIZE - offset;
+	*data = port->rxRing + offset;
+	return size;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief mark bytes returned by SerialApi_ReceiveChunk() as processed
+*/
+void SerialApi_Consume(SerialApi_t *port, size_t size) {
+	port->rxTail += size;
+}
+
+int SerialApi_ReceiveByte(SerialApi_t *port) {
+	const uint8_t *data;
+	int c;
+
+	if (SerialApi_ReceiveChunk(port, &data) == 0)
+		return -1;
+	c = *data;
+	SerialApi_Consume(port, 1);
+	return c;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief receive block of bytes
+*
+* Reads until the buffer is full or the deadline passes.
+*
+* \return number of bytes received
+*/
+int SerialApi_Receive(SerialApi_t *port, uint8_t *data, size_t size) {
+	size_t received = 0;
+	while (received < size) {
+		const uint8_t *chunk;
+		size_t available = SerialApi_ReceiveChunk(port, &chunk);
+		if (available == 0) {
+			break;
+		}
+		if (available > size - received) {
+			available = size - received;
+		}
+		memcpy(data + received, chunk, available);
+		SerialApi_Consume(port, available);
+		received += available;
+	}
+	return received;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief drop all bytes received but not read yet
+*/
+int SerialApi_Flush(SerialApi_t *port) {
+	port->rxTail = port->rxHead;
+	return port->backend->flush(port);
+}
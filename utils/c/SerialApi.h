@@ -14,10 +14,20 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 
-int SerialApi_Init(const char *deviceName);
-int SerialApi_Close(void);
-int SerialApi_SendByte(uint8_t c);
-int SerialApi_ReceiveByte(void);
+typedef struct SerialApi_Port SerialApi_t;
+
+SerialApi_t *SerialApi_Open(const char *deviceName, unsigned long baudRate);
+int SerialApi_Close(SerialApi_t *port);
+int SerialApi_SendByte(SerialApi_t *port, uint8_t c);
+int SerialApi_Send(SerialApi_t *port, const uint8_t *data, size_t size);
+int SerialApi_ReceiveByte(SerialApi_t *port);
+int SerialApi_Receive(SerialApi_t *port, uint8_t *data, size_t size);
+int SerialApi_ReceiveChunk(SerialApi_t *port, const uint8_t **data);
+void SerialApi_Consume(SerialApi_t *port, size_t size);
+int SerialApi_Flush(SerialApi_t *port);
+int SerialApi_SetDeadline(SerialApi_t *port, const struct timespec *deadline);
+unsigned long SerialApi_GetBaudRate(SerialApi_t *port);
 
 #endif
@@ -0,0 +1,54 @@
+/*!
+* \file SerialApiBackend.h
+* \brief interface between generic serial port layer and transport backends
+*
+* Every backend allocates its own port structure starting with
+* struct SerialApi_Port, the generic layer owns the receive ring.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#ifndef SERIAL_API_BACKEND_H
+#define SERIAL_API_BACKEND_H
+
+#include "SerialApi.h"
+
+// receive ring, must be power of two
+#define SERIAL_API_RX_RING_SIZE 4096
+#define SERIAL_API_RX_RING_MASK (SERIAL_API_RX_RING_SIZE-1)
+
+typedef struct {
+	const char *prefix;	//! device name prefix selecting the backend, e.g. "pty:"
+
+	//! open port, deviceName is without the prefix
+	SerialApi_t *(*open)(const char *deviceName, unsigned long baudRate);
+	int (*close)(SerialApi_t *port);
+	//! send whole block
+	int (*send)(SerialApi_t *port, const uint8_t *data, size_t size);
+	//! store received bytes to buffer, wait up to the deadline if none, return count (0 on timeout)
+	int (*fill)(SerialApi_t *port, uint8_t *buffer, size_t space);
+	//! drop bytes buffered by the transport
+	int (*flush)(SerialApi_t *port);
+	int (*setDeadline)(SerialApi_t *port, const struct timespec *deadline);
+} SerialApi_Backend_t;
+
+struct SerialApi_Port {
+	const SerialApi_Backend_t *backend;
+	unsigned long	baudRate;
+	uint8_t		rxRing[SERIAL_API_RX_RING_SIZE];
+	size_t		rxHead; //! total bytes stored (free running)
+	size_t		rxTail; //! total bytes consumed (free running)
+};
+
+extern const SerialApi_Backend_t SerialApi_TtyBackend;
+extern const SerialApi_Backend_t SerialApi_PtyBackend;
+extern const SerialApi_Backend_t SerialApi_LoopbackBackend;
+
+void SerialApi_InitPort(SerialApi_t *port, const SerialApi_Backend_t *backend, unsigned long baudRate);
+size_t SerialApi_Store(SerialApi_t *port, const uint8_t *data, size_t size);
+
+#endif
@@ -11,16 +11,25 @@
 */
 
 //#define _POSIX_SOURCE 1 /* POSIX compliant source */
+#define _GNU_SOURCE /* posix_openpt(), cfmakeraw() */
 
 #include <termios.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/types.h>
 //#include <sys/stat.h>
-//#include <string.h>
+#include <string.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/stat.h>
 
 #include "SerialApi.h"
+#include "SerialApiBackend.h"
 
 /* baudrate settings are defined in <asm/termbits.h>, which is
 included by <termios.h> */
@@ -31,120 +40,450 @@ included by <termios.h> */
 #define IUCLC 0
 #endif /*IUCLC*/
 
-int m_handle;
-struct termios m_oldtio, m_newtio;
+// the port is non-blocking, waiting is done by epoll on the port and a deadline timer
+#define DEFAULT_TIMEOUT_NS 100000000L // used while no deadline is set
 
-int SerialApi_Init(const char *deviceName) {
+typedef struct {
+	struct SerialApi_Port	base;
+	int		handle;
+	int		isTty;		//! oldtio is valid and restored on close
+	struct termios	oldtio, newtio;
+	int		epoll;
+	int		timer;
+	int		deadlineSet;
+	char		*linkPath;	//! symlink to the pty slave removed on close
+} SerialApiLinux_t;
 
-	int a_baudRate = B115200;
+// implemented in SerialApiLinuxBaud.c (<asm/termbits.h> collides with <termios.h>)
+int SerialApi_SetCustomBaudRate(int handle, unsigned long baudRate);
 
-	m_handle = open(deviceName, O_RDWR | O_NOCTTY );
-	if(m_handle < 0)
+static const struct {
+	unsigned long	rate;
+	speed_t		speed;
+} m_baudRates[] = {
+	{ 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 },
+	{ 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 }, { 115200, B115200 },
+	{ 230400, B230400 },
+#ifdef B460800
+	{ 460800, B460800 },
+#endif
+#ifdef B500000
+	{ 500000, B500000 },
+#endif
+#ifdef B576000
+	{ 576000, B576000 },
+#endif
+#ifdef B921600
+	{ 921600, B921600 },
+#endif
+#ifdef B1000000
+	{ 1000000, B1000000 },
+#endif
+#ifdef B1152000
+	{ 1152000, B1152000 },
+#endif
+#ifdef B1500000
+	{ 1500000, B1500000 },
+#endif
+#ifdef B2000000
+	{ 2000000, B2000000 },
+#endif
+#ifdef B3000000
+	{ 3000000, B3000000 },
+#endif
+#ifdef B4000000
+	{ 4000000, B4000000 },
+#endif
+};
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief find termios speed constant for given baud rate
+*
+* \return speed constant or B0 if the rate needs custom divisor
+*/
+static speed_t SerialApi_GetSpeed(unsigned long baudRate) {
+	size_t i;
+	for (i = 0; i < sizeof(m_baudRates)/sizeof(m_baudRates[0]); i++) {
+		if (m_baudRates[i].rate == baudRate)
+			return m_baudRates[i].speed;
+	}
+	return B0;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief allocate port and set up waiting for already opened handle
+*
+* \return port or NULL on failure (handle is closed then)
+*/
+static SerialApiLinux_t *SerialApiLinux_Create(int handle, const SerialApi_Backend_t *backend, unsigned long baudRate) {
+	struct epoll_event event;
+	SerialApiLinux_t *port = calloc(1, sizeof(SerialApiLinux_t));
+	if (port == NULL) {
+		perror("Serial port allocation failed");
+		close(handle);
+		return NULL;
+	}
+
+	SerialApi_InitPort(&port->base, backend, baudRate);
+	port->handle = handle;
+	port->epoll = epoll_create1(EPOLL_CLOEXEC);
+	port->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (port->epoll < 0 || port->timer < 0) {
+		perror("Serial port wait setup failed");
+		if (port->epoll >= 0)
+			close(port->epoll);
+		if (port->timer >= 0)
+			close(port->timer);
+		close(port->handle);
+		free(port);
+		return NULL;
+	}
+	event.events = EPOLLIN;
+	event.data.fd = port->handle;
+	epoll_ctl(port->epoll, EPOLL_CTL_ADD, port->handle, &event);
+	event.events = EPOLLIN;
+	event.data.fd = port->timer;
+	epoll_ctl(port->epoll, EPOLL_CTL_ADD, port->timer, &event);
+
+	return port;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* Destructor
+*/
+static int SerialApiLinux_Close(SerialApi_t *base) {
+	SerialApiLinux_t *port = (SerialApiLinux_t *)base;
+
+	if(port->handle >= 0) {
+		if (port->isTty)
+			tcsetattr(port->handle,TCSANOW,&port->oldtio);
+		close(port->handle);
+		port->handle = -1;
+	}
+	if (port->timer >= 0) {
+		close(port->timer);
+		port->timer = -1;
+	}
+	if (port->epoll >= 0) {
+		close(port->epoll);
+		port->epoll = -1;
+	}
+	if (port->linkPath != NULL) {
+		unlink(port->linkPath);
+		free(port->linkPath);
+	}
+	free(port);
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief open and configure serial port
+*
+* \param deviceName port device
+* \param baudRate bus speed
+* \return port handle or NULL on failure
+*/
+static SerialApi_t *SerialApiTty_Open(const char *deviceName, unsigned long baudRate) {
+
+	speed_t a_baudRate = SerialApi_GetSpeed(baudRate);
+	SerialApiLinux_t *port;
+	int handle;
+
+	handle = open(deviceName, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if(handle < 0)
 	{
 		perror("Serial port opening failed");
-		return m_handle;
+		return NULL;
 	}
+	port = SerialApiLinux_Create(handle, &SerialApi_TtyBackend, baudRate);
+	if (port == NULL)
+		return NULL;
 
-	tcgetattr(m_handle,&m_oldtio); // save current serial port settings 
-	tcgetattr(m_handle,&m_newtio); //and get the working copy 
+	tcgetattr(port->handle,&port->oldtio); // save current serial port settings 
+	tcgetattr(port->handle,&port->newtio); //and get the working copy 
 
-	// speed,
-	cfsetispeed(&m_newtio, a_baudRate);
-	cfsetospeed(&m_newtio, a_baudRate);    
+	// speed, non-standard rates are set by termios2 once the rest is configured
+	if (a_baudRate == B0) {
+		a_baudRate = B38400;
+	}
+	cfsetispeed(&port->newtio, a_baudRate);
+	cfsetospeed(&port->newtio, a_baudRate);    
 	
-	m_newtio.c_cflag &= ~(CBAUD);	//clear bits used for char size
-	m_newtio.c_cflag |= B115200;
+	port->newtio.c_cflag &= ~(CBAUD);	//clear bits used for char size
+	port->newtio.c_cflag |= a_baudRate;
     
 	//char size
-	m_newtio.c_cflag &= ~(CSIZE);	//clear bits used for char size
-	m_newtio.c_cflag |= CS8;
+	port->newtio.c_cflag &= ~(CSIZE);	//clear bits used for char size
+	port->newtio.c_cflag |= CS8;
 
 	//no parity
-	m_newtio.c_cflag &= ~(PARENB);	//clear parity enable
-	m_newtio.c_iflag &= ~(INPCK);	//disable input parity checking
+	port->newtio.c_cflag &= ~(PARENB);	//clear parity enable
+	port->newtio.c_iflag &= ~(INPCK);	//disable input parity checking
   
 	 //one stop bit - default
-	m_newtio.c_cflag &= ~(CSTOPB);	//clear parity enable
+	port->newtio.c_cflag &= ~(CSTOPB);	//clear parity enable
 
 	//no sw flow control
-	//FIXME removed to start functioning m_newtio.c_cflag &= ~(IXON | IXOFF | IXANY);
+	//FIXME removed to start functioning port->newtio.c_cflag &= ~(IXON | IXOFF | IXANY);
 
 	//no hw flow control
-	m_newtio.c_cflag &= ~(CRTSCTS); //this is not POSIX compliant! It might be omitted, if the device is already set to 'no hardware flow control"
+	port->newtio.c_cflag &= ~(CRTSCTS); //this is not POSIX compliant! It might be omitted, if the device is already set to 'no hardware flow control"
 
 	//raw output
-	m_newtio.c_lflag = 0;		//no local flags
-	m_newtio.c_oflag &= ~(OPOST);	//no output processing
-	m_newtio.c_oflag &= ~(ONLCR);	//don't convert line feeds
+	port->newtio.c_lflag = 0;		//no local flags
+	port->newtio.c_oflag &= ~(OPOST);	//no output processing
+	port->newtio.c_oflag &= ~(ONLCR);	//don't convert line feeds
 
 	//no input processing
-	m_newtio.c_iflag &= ~(INPCK | PARMRK | BRKINT | INLCR | ICRNL | IUCLC | IXANY);
+	port->newtio.c_iflag &= ~(INPCK | PARMRK | BRKINT | INLCR | ICRNL | IUCLC | IXANY);
 
 	// ignore break conditions
-	m_newtio.c_iflag |= IGNBRK;
+	port->newtio.c_iflag |= IGNBRK;
 
 	//enable input
-	m_newtio.c_cflag |= CREAD;
+	port->newtio.c_cflag |= CREAD;
 
 	//
  	// * initialize all control characters
 	// * default values can be found in /usr/include/termios.h, and are given
 	// * in the comments, but we don't need them here
 	//
-    	m_newtio.c_cc[VINTR]    = 0;     // Ctrl-c //
-    	m_newtio.c_cc[VQUIT]    = 0;     // Ctrl-\ //
-    	m_newtio.c_cc[VERASE]   = 0;     // del //
-    	m_newtio.c_cc[VKILL]    = 0;     // @ //
-    	m_newtio.c_cc[VEOF]     = 4;     // Ctrl-d //
-    	m_newtio.c_cc[VTIME]    = 1;     // inter-character timer (in 0.1s)//
-    	m_newtio.c_cc[VMIN]     = 0;     // non-blocking read //
-    	m_newtio.c_cc[VSWTC]    = 0;     // '\0' //
-    	m_newtio.c_cc[VSTART]   = 0;     // Ctrl-q //
-    	m_newtio.c_cc[VSTOP]    = 0;     // Ctrl-s //
-    	m_newtio.c_cc[VSUSP]    = 0;     // Ctrl-z //
-    	m_newtio.c_cc[VEOL]     = 0;     // '\0' //
-    	m_newtio.c_cc[VREPRINT] = 0;     // Ctrl-r //
-    	m_newtio.c_cc[VDISCARD] = 0;     // Ctrl-u //
-    	m_newtio.c_cc[VWERASE]  = 0;     // Ctrl-w //
-    	m_newtio.c_cc[VLNEXT]   = 0;     // Ctrl-v //
-    	m_newtio.c_cc[VEOL2]    = 0;     // '\0' //
+    	port->newtio.c_cc[VINTR]    = 0;     // Ctrl-c //
+    	port->newtio.c_cc[VQUIT]    = 0;     // Ctrl-\ //
+    	port->newtio.c_cc[VERASE]   = 0;     // del //
+    	port->newtio.c_cc[VKILL]    = 0;     // @ //
+    	port->newtio.c_cc[VEOF]     = 4;     // Ctrl-d //
+    	port->newtio.c_cc[VTIME]    = 0;     // no inter-character timer, deadlines are handled by timerfd //
+    	port->newtio.c_cc[VMIN]     = 0;     // non-blocking read //
+    	port->newtio.c_cc[VSWTC]    = 0;     // '\0' //
+    	port->newtio.c_cc[VSTART]   = 0;     // Ctrl-q //
+    	port->newtio.c_cc[VSTOP]    = 0;     // Ctrl-s //
+    	port->newtio.c_cc[VSUSP]    = 0;     // Ctrl-z //
+    	port->newtio.c_cc[VEOL]     = 0;     // '\0' //
+    	port->newtio.c_cc[VREPRINT] = 0;     // Ctrl-r //
+    	port->newtio.c_cc[VDISCARD] = 0;     // Ctrl-u //
+    	port->newtio.c_cc[VWERASE]  = 0;     // Ctrl-w //
+    	port->newtio.c_cc[VLNEXT]   = 0;     // Ctrl-v //
+    	port->newtio.c_cc[VEOL2]    = 0;     // '\0' //
 
     	// now clean the modem line and activate the settings for the port
-    	tcflush(m_handle, TCIFLUSH);
-    	if(tcsetattr(m_handle, TCSANOW, &m_newtio) == -1)
+    	tcflush(port->handle, TCIFLUSH);
+    	if(tcsetattr(port->handle, TCSANOW, &port->newtio) == -1)
    	{
       		perror("tcsetattr Error");
     	}
 
-	return 0;
+	port->isTty = 1;
+
+	if (SerialApi_GetSpeed(baudRate) == B0 && SerialApi_SetCustomBaudRate(port->handle, baudRate) != 0) {
+		perror("Setting custom baud rate failed");
+		SerialApiLinux_Close(&port->base);
+		return NULL;
+	}
+
+	return &port->base;
 }
 
 ///////////////////////////////////////////////////////////
 /*!
-* Destructor
+* \brief create pseudo terminal, nodes simulated by another program
+* connect to its slave side
+*
+* \param deviceName optional path of a symlink to the slave side
+* \param baudRate bus speed used for timeouts only
+* \return port handle or NULL on failure
+*/
+static SerialApi_t *SerialApiPty_Open(const char *deviceName, unsigned long baudRate) {
+	SerialApiLinux_t *port;
+	struct termios tio;
+	const char *slaveName;
+	int handle;
+
+	handle = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (handle < 0 || grantpt(handle) != 0 || unlockpt(handle) != 0 || (slaveName = ptsname(handle)) == NULL) {
+		perror("Pseudo terminal opening failed");
+		if (handle >= 0)
+			close(handle);
+		return NULL;
+	}
+	port = SerialApiLinux_Create(handle, &SerialApi_PtyBackend, baudRate);
+	if (port == NULL)
+		return NULL;
+
+	tcgetattr(port->handle, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(port->handle, TCSANOW, &tio);
+
+	if (deviceName[0] != '\0') {
+		unlink(deviceName);
+		if (symlink(slaveName, deviceName) != 0) {
+			perror("Pseudo terminal link failed");
+			SerialApiLinux_Close(&port->base);
+			return NULL;
+		}
+		port->linkPath = strdup(deviceName);
+	}
+	printf("Pseudo terminal bus at %s, waiting for nodes to connect\n", deviceName[0] != '\0' ? deviceName : slaveName);
+
+	// master reports hangup only after the slave side was closed once,
+	// then until somebody opens it again
+	handle = open(slaveName, O_RDWR | O_NOCTTY);
+	if (handle >= 0)
+		close(handle);
+	for (;;) {
+		struct pollfd pfd = { port->handle, POLLIN, 0 };
+		struct timespec delay = { 0, 10000000L };
+		if (poll(&pfd, 1, 0) < 0 || !(pfd.revents & POLLHUP))
+			break;
+		nanosleep(&delay, NULL);
+	}
+
+	return &port->base;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief set absolute time when waiting for received data gives up
+*
+* \param deadline CLOCK_MONOTONIC time, NULL restores the default
+* inter-character timeout
+*/
+static int SerialApiLinux_SetDeadline(SerialApi_t *base, const struct timespec *deadline) {
+	SerialApiLinux_t *port = (SerialApiLinux_t *)base;
+	struct itimerspec timer;
+
+	if (deadline == NULL) {
+		port->deadlineSet = 0;
+		return 0;
+	}
+
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_nsec = 0;
+	timer.it_value = *deadline;
+	port->deadlineSet = 1;
+	return timerfd_settime(port->timer, TFD_TIMER_ABSTIME, &timer, NULL);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief wait until the port is readable or the deadline passes
+*
+* \return 1 if there are data to read, 0 on timeout or error
 */
-int SerialApi_Close(void) {
-	if(m_handle >= 0) {
-		tcsetattr(m_handle,TCSANOW,&m_oldtio);
-		close(m_handle);
-		m_handle = -1;
+static int SerialApiLinux_Wait(SerialApiLinux_t *port) {
+	struct epoll_event events[2];
+	int i, count;
+
+	if (!port->deadlineSet) {
+		struct itimerspec timer;
+		timer.it_interval.tv_sec = 0;
+		timer.it_interval.tv_nsec = 0;
+		timer.it_value.tv_sec = 0;
+		timer.it_value.tv_nsec = DEFAULT_TIMEOUT_NS;
+		timerfd_settime(port->timer, 0, &timer, NULL);
 	}
 
+	for (;;) {
+		int expired = 0;
+
+		count = epoll_wait(port->epoll, events, 2, -1);
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count < 0)
+			return 0;
+
+		for (i = 0; i < count; i++) {
+			if (events[i].data.fd == port->handle)
+				return 1; // data win over an expired deadline
+			expired = 1;
+		}
+		if (expired)
+			return 0;
+	}
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief send block of bytes by as few writes as possible
+*
+* \param data bytes to send
+* \param size number of bytes
+*/
+static int SerialApiLinux_Send(SerialApi_t *base, const uint8_t *data, size_t size) {
+	SerialApiLinux_t *port = (SerialApiLinux_t *)base;
+
+	while (size > 0) {
+		ssize_t written = write(port->handle, data, size);
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written < 0 && errno == EAGAIN) {
+			// output queue full, wait until it drains a bit
+			struct pollfd pfd = { port->handle, POLLOUT, 0 };
+			poll(&pfd, 1, -1);
+			continue;
+		}
+		if (written <= 0) {
+			return -1;
+		}
+		data += written;
+		size -= written;
+	}
 	return 0;
 }
 
 ///////////////////////////////////////////////////////////
 /*!
-* \brief send single byte
+* \brief read whatever the tty holds by a single read
 *
-* \param a_toSend byte to send
+* Waits for data up to the deadline if the tty is empty.
+*
+* \return number of bytes read (0 on timeout)
 */
-int SerialApi_SendByte(uint8_t c) {
-	return write(m_handle, &c, 1) == 1 ? 0 : -1;
+static int SerialApiLinux_Fill(SerialApi_t *base, uint8_t *buffer, size_t space) {
+	SerialApiLinux_t *port = (SerialApiLinux_t *)base;
+	ssize_t ret;
+
+	for (;;) {
+		ret = read(port->handle, buffer, space);
+		if (ret > 0)
+			return ret;
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0 && errno != EAGAIN)
+			return 0;
+
+		// nothing buffered by the tty
+		if (!SerialApiLinux_Wait(port))
+			return 0;
+	}
 }
 
-int SerialApi_ReceiveByte(void) {
-  uint8_t data;
-  return read(m_handle, &data, 1) == 1 ? data : -1;
+static int SerialApiLinux_Flush(SerialApi_t *base) {
+	return tcflush(((SerialApiLinux_t *)base)->handle, TCIFLUSH);
 }
 
+const SerialApi_Backend_t SerialApi_TtyBackend = {
+	"tty:",
+	SerialApiTty_Open,
+	SerialApiLinux_Close,
+	SerialApiLinux_Send,
+	SerialApiLinux_Fill,
+	SerialApiLinux_Flush,
+	SerialApiLinux_SetDeadline
+};
+
+const SerialApi_Backend_t SerialApi_PtyBackend = {
+	"pty:",
+	SerialApiPty_Open,
+	SerialApiLinux_Close,
+	SerialApiLinux_Send,
+	SerialApiLinux_Fill,
+	SerialApiLinux_Flush,
+	SerialApiLinux_SetDeadline
+};
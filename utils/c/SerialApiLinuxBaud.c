@@ -0,0 +1,48 @@
+/*!
+* \file SerialApiLinuxBaud.c
+* \brief arbitrary baud rates for Linux serial ports
+*
+* Kept apart from SerialApiLinux.c, because termios2 definitions
+* in <asm/termbits.h> collide with <termios.h>.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+
+int SerialApi_SetCustomBaudRate(int handle, unsigned long baudRate);
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief set baud rate not covered by the Bxxx constants (250k, 500k, 1M...)
+*
+* \param handle open serial port
+* \param baudRate requested rate in bits per second
+*/
+int SerialApi_SetCustomBaudRate(int handle, unsigned long baudRate) {
+#if defined(TCGETS2) && defined(BOTHER)
+	struct termios2 tio;
+
+	if (ioctl(handle, TCGETS2, &tio) != 0)
+		return -1;
+
+	tio.c_cflag &= ~CBAUD;
+	tio.c_cflag |= BOTHER;
+#ifdef IBSHIFT
+	tio.c_cflag &= ~(CBAUD << IBSHIFT);
+	tio.c_cflag |= BOTHER << IBSHIFT;
+#endif
+	tio.c_ispeed = baudRate;
+	tio.c_ospeed = baudRate;
+	return ioctl(handle, TCSETS2, &tio);
+#else
+	errno = EINVAL;
+	return -1;
+#endif
+}
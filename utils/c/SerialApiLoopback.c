@@ -0,0 +1,132 @@
+/*!
+* \file SerialApiLoopback.c
+* \brief in-process bus with nodes simulated by the firmware state machine
+*
+* Sent bytes are echoed back like on the half-duplex bus and passed to
+* RobbusSlaveSim, which answers for every address from the configured
+* range. Group packets are played to every simulated node in turn, so
+* group read replies follow each other in slot order. Replies are
+* complete by the time the send returns, so waiting for data never
+* blocks and missing replies time out immediately.
+* Device name is "loop:LOW-HIGH", the range defaults to all addresses.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "SerialApi.h"
+#include "SerialApiBackend.h"
+#include "RobbusSlaveSim.h"
+
+#define LOOPBACK_ADDRESS_MIN 0x04
+#define LOOPBACK_ADDRESS_MAX 0x7f
+
+#define LOOPBACK_HEAD_MAX 0x03
+#define LOOPBACK_GROUP_HEAD 0x03
+
+typedef struct {
+	struct SerialApi_Port	base;
+	uint8_t	lowAddress;	//! simulated nodes
+	uint8_t	highAddress;
+	uint8_t	previous;	//! last byte sent, address follows packet head
+} SerialApiLoopback_t;
+
+// single simulated state machine shared by all loopback ports
+static pthread_mutex_t m_simLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t m_simOnce = PTHREAD_ONCE_INIT;
+
+static SerialApi_t *SerialApiLoopback_Open(const char *deviceName, unsigned long baudRate) {
+	SerialApiLoopback_t *port;
+	unsigned int low = LOOPBACK_ADDRESS_MIN, high = LOOPBACK_ADDRESS_MAX;
+
+	if (deviceName[0] != '\0' && (sscanf(deviceName, "%u-%u", &low, &high) != 2
+			|| low < LOOPBACK_ADDRESS_MIN || high > LOOPBACK_ADDRESS_MAX || low > high)) {
+		printf("Invalid loopback address range %s\n", deviceName);
+		return NULL;
+	}
+
+	port = calloc(1, sizeof(SerialApiLoopback_t));
+	if (port == NULL) {
+		perror("Serial port allocation failed");
+		return NULL;
+	}
+	SerialApi_InitPort(&port->base, &SerialApi_LoopbackBackend, baudRate);
+	port->lowAddress = low;
+	port->highAddress = high;
+
+	pthread_once(&m_simOnce, RobbusSlaveSim_Init);
+	return &port->base;
+}
+
+static int SerialApiLoopback_Close(SerialApi_t *port) {
+	free(port);
+	return 0;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief echo the bytes and let the simulated nodes process them
+*/
+static int SerialApiLoopback_Send(SerialApi_t *base, const uint8_t *data, size_t size) {
+	SerialApiLoopback_t *port = (SerialApiLoopback_t *)base;
+	uint8_t reply[ROBBUS_SLAVE_SIM_REPLY_MAX];
+	size_t i;
+
+	SerialApi_Store(base, data, size);
+
+	pthread_mutex_lock(&m_simLock);
+	if (size > 0 && data[0] == LOOPBACK_GROUP_HEAD) {
+		// whole group packet, every node gets its own copy
+		unsigned int address;
+		for (address = port->lowAddress; address <= port->highAddress; address++) {
+			RobbusSlaveSim_SetAddress(address);
+			for (i = 0; i < size; i++)
+				SerialApi_Store(base, reply, RobbusSlaveSim_Feed(data[i], reply));
+		}
+		port->previous = data[size-1];
+		pthread_mutex_unlock(&m_simLock);
+		return 0;
+	}
+	for (i = 0; i < size; i++) {
+		uint8_t c = data[i];
+
+		if (port->previous != 0 && port->previous <= LOOPBACK_HEAD_MAX) {
+			// 0 is never used as address, nobody answers then
+			RobbusSlaveSim_SetAddress(c >= port->lowAddress && c <= port->highAddress ? c : 0);
+		}
+		port->previous = c;
+
+		SerialApi_Store(base, reply, RobbusSlaveSim_Feed(c, reply));
+	}
+	pthread_mutex_unlock(&m_simLock);
+
+	return 0;
+}
+
+static int SerialApiLoopback_Fill(SerialApi_t *port, uint8_t *buffer, size_t space) {
+	return 0; // everything was stored while sending
+}
+
+static int SerialApiLoopback_Flush(SerialApi_t *port) {
+	return 0;
+}
+
+static int SerialApiLoopback_SetDeadline(SerialApi_t *port, const struct timespec *deadline) {
+	return 0;
+}
+
+const SerialApi_Backend_t SerialApi_LoopbackBackend = {
+	"loop:",
+	SerialApiLoopback_Open,
+	SerialApiLoopback_Close,
+	SerialApiLoopback_Send,
+	SerialApiLoopback_Fill,
+	SerialApiLoopback_Flush,
+	SerialApiLoopback_SetDeadline
+};
@@ -0,0 +1,24 @@
+/*!
+* \file avrsim/avr/eeprom.h
+* \brief minimal host replacement of <avr/eeprom.h> backed by memory
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#ifndef AVRSIM_AVR_EEPROM_H
+#define AVRSIM_AVR_EEPROM_H
+
+#include <stdint.h>
+
+#define AVRSIM_EEPROM_SIZE 512
+
+extern uint8_t AvrSim_Eeprom[AVRSIM_EEPROM_SIZE];
+
+#define eeprom_read_byte(address) (AvrSim_Eeprom[(uintptr_t)(address)])
+#define eeprom_write_byte(address, value) (AvrSim_Eeprom[(uintptr_t)(address)] = (value))
+
+#endif
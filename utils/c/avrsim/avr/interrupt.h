@@ -0,0 +1,31 @@
+/*!
+* \file avrsim/avr/interrupt.h
+* \brief minimal host replacement of <avr/interrupt.h>
+*
+* Interrupt routines become ordinary functions called by the simulator.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#ifndef AVRSIM_AVR_INTERRUPT_H
+#define AVRSIM_AVR_INTERRUPT_H
+
+#define ISR(vector) void vector(void)
+
+#define USART_RXC_vect AvrSim_UsartRxInterrupt
+#define USART_TXC_vect AvrSim_UsartTxInterrupt
+#define USART_UDRE_vect AvrSim_UsartUdreInterrupt
+#define TIMER1_COMPA_vect AvrSim_Timer1CompareInterrupt
+
+void AvrSim_UsartRxInterrupt(void);
+void AvrSim_UsartTxInterrupt(void);
+void AvrSim_Timer1CompareInterrupt(void);
+
+#define sei()
+#define cli()
+
+#endif
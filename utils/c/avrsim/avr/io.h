@@ -0,0 +1,58 @@
+/*!
+* \file avrsim/avr/io.h
+* \brief minimal host replacement of <avr/io.h> for RobbusSlaveSim.c
+*
+* USART and Timer1 registers are plain variables. UDR is wider than a byte, so
+* the simulator can tell whether the firmware wrote anything: it stores
+* AVRSIM_UDR_EMPTY before calling the transmit interrupt.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#ifndef AVRSIM_AVR_IO_H
+#define AVRSIM_AVR_IO_H
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+#define AVRSIM_UDR_EMPTY 0x100
+
+extern volatile uint16_t AvrSim_UDR;
+extern volatile uint8_t AvrSim_UCSRA, AvrSim_UCSRB, AvrSim_UBRRL, AvrSim_UBRRH;
+
+#define UDR AvrSim_UDR
+#define UCSRA AvrSim_UCSRA
+#define UCSRB AvrSim_UCSRB
+#define UBRRL AvrSim_UBRRL
+#define UBRRH AvrSim_UBRRH
+
+extern volatile uint8_t AvrSim_TCCR1B, AvrSim_TIMSK, AvrSim_TIFR;
+extern volatile uint16_t AvrSim_TCNT1, AvrSim_OCR1A;
+
+#define TCCR1B AvrSim_TCCR1B
+#define TCNT1 AvrSim_TCNT1
+#define OCR1A AvrSim_OCR1A
+#define TIMSK AvrSim_TIMSK
+#define TIFR AvrSim_TIFR
+
+// UCSRA
+#define U2X 1
+// UCSRB
+#define RXCIE 7
+#define TXCIE 6
+#define UDRIE 5
+#define RXEN 4
+#define TXEN 3
+// TCCR1B
+#define CS12 2
+// TIMSK
+#define OCIE1A 4
+// TIFR
+#define OCF1A 4
+
+#endif
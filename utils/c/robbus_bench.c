@@ -0,0 +1,292 @@
+/*!
+* \file robbus_bench.c
+* \brief master side cost per transaction measured on loopback buses
+*
+* Nodes are simulated in-process by the firmware state machine, so the
+* numbers show the host overhead only, without waiting for the wire.
+* With -m the frame encoder and decoder alone are measured, with and
+* without vector instructions, with -a transactions go through the
+* RobbusAsync queue of each bus.
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "RobbusComm.h"
+#include "RobbusFrame.h"
+#include "RobbusAsync.h"
+
+// addresses available on a single loopback bus
+#define BENCH_ADDRESS_FIRST 4
+#define BENCH_ADDRESS_LAST 127
+#define BENCH_NODES_PER_BUS (BENCH_ADDRESS_LAST - BENCH_ADDRESS_FIRST + 1)
+
+// payload sizes of the simulated node (avr/test_v3)
+#define BENCH_IN_SIZE 1
+#define BENCH_OUT_SIZE 1
+
+void printUsage(void) {
+	printf("Robbus master benchmark on in-process loopback buses\n");
+	printf("Usage: robbus_bench [-h] [-m] [-a] [-n nodes] [-i iterations] [-b baudrate]\n");
+	printf("-h This help message\n");
+	printf("-n Number of simulated nodes, %d per bus (default 1000)\n", BENCH_NODES_PER_BUS);
+	printf("-i Number of sync rounds over all nodes (default 100)\n");
+	printf("-b Baud rate the wire time is compared with (default %lu)\n", ROBBUS_DEFAULT_BAUDRATE);
+	printf("-m Measure frame encoding and decoding of full size payloads instead\n");
+	printf("-a Submit transactions of each round at once and wait for their completions\n");
+}
+
+static double elapsedNs(const struct timespec *start, const struct timespec *end) {
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief encode and decode frames with given share of special characters
+*
+* \param specialPercent how many payload bytes need wrapping
+* \return number of frames which did not decode to the original payload
+*/
+static int benchCodec(int frames, int specialPercent) {
+	uint8_t payload[255], decoded[255];
+	uint8_t frame[ROBBUS_FRAME_MAX_SIZE];
+	struct timespec start, end;
+	size_t frameBytes = 0;
+	int vectorized, i, errors = 0;
+
+	srand(specialPercent);
+	for (i = 0; i < sizeof(payload); i++) {
+		payload[i] = (rand() % 100 < specialPercent) ? rand() % ROBBUS_SPECIAL_CHAR_SHIFT
+			: ROBBUS_SPECIAL_CHAR_SHIFT + rand() % (256 - ROBBUS_SPECIAL_CHAR_SHIFT);
+	}
+
+	for (vectorized = 0; vectorized <= 1; vectorized++) {
+		double encodeNs, decodeNs;
+		size_t length = 0;
+
+		RobbusFrame_SetVectorized(vectorized);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < frames; i++) {
+			length = RobbusFrame_Build(frame, ROBBUS_TAG_REGULAR, BENCH_ADDRESS_FIRST | ROBBUS_ADDRESS_REPLY_MASK,
+				payload, sizeof(payload));
+			__asm__ volatile("" : : "r"(frame) : "memory"); // keep the work
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		encodeNs = elapsedNs(&start, &end);
+		frameBytes = length;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < frames; i++) {
+			RobbusFrame_Decoder_t decoder;
+			size_t consumed;
+
+			RobbusFrame_DecoderInit(&decoder, ROBBUS_TAG_REGULAR, BENCH_ADDRESS_FIRST, decoded, sizeof(decoded));
+			if (RobbusFrame_Decode(&decoder, frame, length, &consumed) != RBC_SUCCESS)
+				errors++;
+			__asm__ volatile("" : : "r"(decoded) : "memory");
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		decodeNs = elapsedNs(&start, &end);
+		if (memcmp(payload, decoded, sizeof(payload)) != 0)
+			errors++;
+
+		printf("%3d%% special, %-6s: encode %6.1f ns/frame (%5.2f ns/byte), decode %6.1f ns/frame (%5.2f ns/byte)\n",
+			specialPercent, vectorized ? "vector" : "scalar",
+			encodeNs / frames, encodeNs / frames / sizeof(payload),
+			decodeNs / frames, decodeNs / frames / sizeof(payload));
+	}
+	printf("      frame %lu bytes for %lu byte payload\n", (unsigned long)frameBytes, (unsigned long)sizeof(payload));
+	RobbusFrame_SetVectorized(1);
+	return errors;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief one round over all nodes through the async queues
+*
+* \return number of failed transactions
+*/
+static unsigned long benchAsyncRound(RobbusAsync_t **asyncs, RobbusAsync_Transaction_t *transactions,
+	uint8_t (*inData)[BENCH_IN_SIZE], uint8_t (*outData)[BENCH_OUT_SIZE], int nodeCount, int round) {
+	unsigned long errors = 0;
+	int node;
+
+	for (node = 0; node < nodeCount; node++) {
+		RobbusAsync_Transaction_t *transaction = &transactions[node];
+
+		memset(inData[node], round + node, BENCH_IN_SIZE);
+		memset(transaction, 0, sizeof(RobbusAsync_Transaction_t));
+		transaction->tag = ROBBUS_TAG_REGULAR;
+		transaction->address = BENCH_ADDRESS_FIRST + node % BENCH_NODES_PER_BUS;
+		transaction->data = inData[node];
+		transaction->size = BENCH_IN_SIZE;
+		transaction->reply = outData[node];
+		transaction->replySize = BENCH_OUT_SIZE;
+		transaction->token = asyncs[node / BENCH_NODES_PER_BUS];
+		if (RobbusAsync_Submit(transaction->token, transaction) != RBC_SUCCESS)
+			errors++;
+	}
+	for (node = 0; node < nodeCount; node += BENCH_NODES_PER_BUS) {
+		int bus = node / BENCH_NODES_PER_BUS, count = nodeCount - node;
+		if (count > BENCH_NODES_PER_BUS)
+			count = BENCH_NODES_PER_BUS;
+		while (count-- > 0) {
+			RobbusAsync_Transaction_t *transaction = RobbusAsync_GetCompletion(asyncs[bus], NULL);
+			int index = transaction - transactions;
+			if (transaction->result != RBC_SUCCESS || outData[index][0] != (uint8_t)~inData[index][0])
+				errors++;
+		}
+	}
+	return errors;
+}
+
+int main (int argc, char **argv) {
+
+	int opt;
+	int nodeCount = 1000;
+	int iterations = 100;
+	int codec = 0;
+	int async = 0;
+	RobbusAsync_t **asyncs = NULL;
+	RobbusAsync_Transaction_t *asyncTransactions = NULL;
+	uint8_t (*asyncIn)[BENCH_IN_SIZE] = NULL;
+	uint8_t (*asyncOut)[BENCH_OUT_SIZE] = NULL;
+	unsigned long baudRate = ROBBUS_DEFAULT_BAUDRATE;
+	RobbusComm_t **comms;
+	int busCount, bus, node, i;
+	unsigned long transactions = 0, errors = 0;
+	struct timespec wallStart, wallEnd, cpuStart, cpuEnd;
+	uint8_t frame[ROBBUS_FRAME_MAX_SIZE];
+	uint8_t payload[BENCH_OUT_SIZE];
+	double wallNs, cpuNs, wireNs;
+	size_t wireBytes;
+
+	while ((opt=getopt(argc, argv, "hman:i:b:")) != -1) {
+		switch (opt) {
+			case 'n':
+				nodeCount = atoi(optarg);
+				break;
+			case 'i':
+				iterations = atoi(optarg);
+				break;
+			case 'b':
+				baudRate = strtoul(optarg, NULL, 10);
+				break;
+			case 'm':
+				codec = 1;
+				break;
+			case 'a':
+				async = 1;
+				break;
+			default:
+				printUsage();
+				exit(1);
+		}
+	}
+	if (nodeCount <= 0 || iterations <= 0 || baudRate == 0) {
+		printUsage();
+		exit(1);
+	}
+
+	if (codec) {
+		int frames = nodeCount * iterations;
+		printf("Benchmarking frame codec, %d frame(s)\n", frames);
+		errors = benchCodec(frames, 0) + benchCodec(frames, 2) + benchCodec(frames, 25);
+		printf("Errors: %lu\n", errors);
+		return errors != 0;
+	}
+
+	busCount = (nodeCount + BENCH_NODES_PER_BUS - 1) / BENCH_NODES_PER_BUS;
+	comms = malloc(busCount * sizeof(RobbusComm_t*));
+	for (bus = 0; bus < busCount; bus++) {
+		char deviceName[32];
+		int nodes = nodeCount - bus * BENCH_NODES_PER_BUS;
+		if (nodes > BENCH_NODES_PER_BUS)
+			nodes = BENCH_NODES_PER_BUS;
+		snprintf(deviceName, sizeof(deviceName), "loop:%d-%d",
+			BENCH_ADDRESS_FIRST, BENCH_ADDRESS_FIRST + nodes - 1);
+		comms[bus] = RobbusComm_Open(deviceName, baudRate);
+		if (comms[bus] == NULL) {
+			printf("Unable to open %s\n", deviceName);
+			exit(1);
+		}
+	}
+
+	if (async) {
+		asyncs = malloc(busCount * sizeof(RobbusAsync_t*));
+		for (bus = 0; bus < busCount; bus++) {
+			asyncs[bus] = RobbusAsync_Create(comms[bus]);
+			if (asyncs[bus] == NULL)
+				exit(1);
+		}
+		asyncTransactions = malloc(nodeCount * sizeof(RobbusAsync_Transaction_t));
+		asyncIn = malloc(nodeCount * BENCH_IN_SIZE);
+		asyncOut = malloc(nodeCount * BENCH_OUT_SIZE);
+	}
+
+	printf("Benchmarking %d node(s) on %d bus(es), %d iteration(s)%s\n", nodeCount, busCount, iterations,
+		async ? ", async" : "");
+
+	clock_gettime(CLOCK_MONOTONIC, &wallStart);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuStart);
+	for (i = 0; async && i < iterations; i++) {
+		errors += benchAsyncRound(asyncs, asyncTransactions, asyncIn, asyncOut, nodeCount, i);
+		transactions += nodeCount;
+	}
+	for (i = 0; !async && i < iterations; i++) {
+		for (node = 0; node < nodeCount; node++) {
+			RobbusComm_t *comm = comms[node / BENCH_NODES_PER_BUS];
+			uint8_t address = BENCH_ADDRESS_FIRST + node % BENCH_NODES_PER_BUS;
+			uint8_t inData[BENCH_IN_SIZE];
+
+			memset(inData, i + node, sizeof(inData));
+			transactions++;
+			if (RobbusComm_SendData(comm, ROBBUS_TAG_REGULAR, address, inData, sizeof(inData)) != 0
+				|| RobbusComm_ReceiveData(comm, ROBBUS_TAG_REGULAR, address, payload, sizeof(payload)) != 0
+				|| payload[0] != (uint8_t)~inData[0]) {
+				errors++;
+			}
+		}
+	}
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuEnd);
+	clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+
+	wallNs = elapsedNs(&wallStart, &wallEnd);
+	cpuNs = elapsedNs(&cpuStart, &cpuEnd);
+
+	// the same transaction on the wire: request, reply and node turnaround
+	memset(payload, 0x55, sizeof(payload));
+	wireBytes = RobbusFrame_Build(frame, ROBBUS_TAG_REGULAR, BENCH_ADDRESS_FIRST, payload, BENCH_IN_SIZE)
+		+ RobbusFrame_Build(frame, ROBBUS_TAG_REGULAR, BENCH_ADDRESS_FIRST | ROBBUS_ADDRESS_REPLY_MASK, payload, BENCH_OUT_SIZE);
+	wireNs = wireBytes * 10 * 1e9 / baudRate;
+
+	printf("Transactions: %lu, errors: %lu\n", transactions, errors);
+	printf("Wall time: %.1f ns/transaction (%.0f transactions/s)\n",
+		wallNs / transactions, transactions * 1e9 / wallNs);
+	printf("CPU time: %.1f ns/transaction\n", cpuNs / transactions);
+	printf("Wire time at %lu baud: %.1f ns/transaction without turnaround (%.1fx host time)\n",
+		baudRate, wireNs, wireNs * transactions / wallNs);
+
+	for (bus = 0; bus < busCount; bus++) {
+		if (async)
+			RobbusAsync_Destroy(asyncs[bus]);
+		RobbusComm_Close(comms[bus]);
+	}
+	free(asyncs);
+	free(asyncTransactions);
+	free(asyncIn);
+	free(asyncOut);
+	free(comms);
+	return errors != 0;
+}
@@ -0,0 +1,114 @@
+/*!
+* \file robbus_bulk.c
+* \brief transfer of files to and from the node bulk buffer
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "RobbusComm.h"
+#include "RobbusLog.h"
+
+#define BULK_MAX_SIZE 0xffff
+
+void printUsage(void) {
+	printf("Robbus bulk transfer tool\n");
+	printf("Usage: robbus_bulk [-h] [-d device] [-b baudrate] [-t turnaround] [-r size] address file\n");
+	printf("-h This help message\n");
+	printf("-d Use given device instead of default /dev/robbus\n");
+	printf("-b Use given baud rate instead of default %lu\n", ROBBUS_DEFAULT_BAUDRATE);
+	printf("-t Time in us given to a node to start its reply (default %lu)\n", ROBBUS_DEFAULT_TURNAROUND_US);
+	printf("-r Read size bytes from the node to the file instead of writing the file to the node\n");
+	printf("address decimal node address\n");
+}
+
+int main (int argc, char **argv) {
+
+	int opt, ret;
+	char *deviceName = ROBBUS_DEFAULT_DEVICE;
+	unsigned long baudRate = ROBBUS_DEFAULT_BAUDRATE;
+	unsigned long turnaround = ROBBUS_DEFAULT_TURNAROUND_US;
+	size_t readSize = 0, size;
+	uint8_t address;
+	static uint8_t data[BULK_MAX_SIZE];
+	RobbusComm_t *comm;
+	FILE *f;
+
+	while ((opt=getopt(argc, argv, "hd:b:t:r:")) != -1) {
+		switch (opt) {
+			case 'd':
+				deviceName = optarg;
+				break;
+			case 'b':
+				baudRate = strtoul(optarg, NULL, 10);
+				break;
+			case 't':
+				turnaround = strtoul(optarg, NULL, 10);
+				break;
+			case 'r':
+				readSize = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				printUsage();
+				exit(1);
+		}
+	}
+
+	if (optind != argc-2 || readSize > BULK_MAX_SIZE) {
+		printUsage();
+		exit(1);
+	}
+	address = atoi(argv[argc-2]);
+
+	f = fopen(argv[argc-1], readSize ? "wb" : "rb");
+	if (f == NULL) {
+		perror("Unable to open file");
+		exit(1);
+	}
+	if (!readSize) {
+		size = fread(data, 1, sizeof(data), f);
+		if (!feof(f)) {
+			printf("File is longer than %d bytes\n", BULK_MAX_SIZE);
+			exit(1);
+		}
+	}
+
+	comm = RobbusComm_Open(deviceName, baudRate);
+	if (comm == NULL) {
+		printf("Unable to open %s\n", deviceName);
+		exit(1);
+	}
+	RobbusComm_SetTurnaround(comm, turnaround);
+
+	if (readSize) {
+		ret = RobbusComm_BulkRead(comm, address, 0, data, readSize);
+		if (ret == RBC_SUCCESS && fwrite(data, 1, readSize, f) != readSize) {
+			perror("Writing file failed");
+			exit(1);
+		}
+		size = readSize;
+	} else {
+		ret = RobbusComm_BulkWrite(comm, address, data, size);
+	}
+	RobbusComm_Close(comm);
+	fclose(f);
+
+	if (ret != RBC_SUCCESS) {
+		RobbusLog_Error("Bulk transfer with node %ld failed (error code %ld)", address, ret);
+		exit(1);
+	}
+	if (readSize)
+		RobbusLog_Info("Transferred %ld byte(s) from node %ld", size, address);
+	else
+		RobbusLog_Info("Transferred %ld byte(s) to node %ld", size, address);
+	return 0;
+}
@@ -18,13 +18,16 @@
 
 #include "RobbusShm.h"
 #include "RobbusNodeList.h"
+#include "RobbusSnapshot.h"
 
 void printUsage(void) {
 	printf("Robbus data display tool\n");
-	printf("Usage: robbus_print [-h] [-i iterations] [-c config]\n");
+	printf("Usage: robbus_print [-h] [-z] [-s] [-i iterations] [-c config]\n");
 	printf("-h This help message\n");
 	printf("-i Run only given number of iterations (default unlimited)\n");
 	printf("-c Use given config file instead of default /etc/robbus/nodes.conf\n");
+	printf("-z Read output slots published per node by robbus_sync -z\n");
+	printf("-s Read output of whole sync rounds, one per bus\n");
 }
 
 
@@ -33,8 +36,13 @@ int main (int argc, char **argv) {
 	int opt;
 	char *configName = ROBBUS_DEFAULT_NODE_LIST_CONFIG;
 	int iterations = -1;
+	int publishPerNode = 0;
+	int useSnapshot = 0;
+	RobbusSnapshot_Header_t *snapshot = NULL;
+	uint8_t *round = NULL;
+	uint64_t *rounds = NULL;	//! round read from each bus
 
-	while ((opt=getopt(argc, argv, "hc:i:")) != -1) {
+	while ((opt=getopt(argc, argv, "hzsc:i:")) != -1) {
 		switch (opt) {
 			case 'c':
 				configName = optarg;
@@ -42,6 +50,12 @@ int main (int argc, char **argv) {
 			case 'i':
 				iterations = atoi(optarg);
 				break;
+			case 'z':
+				publishPerNode = 1;
+				break;
+			case 's':
+				useSnapshot = 1;
+				break;
 			default:
 				printUsage();
 				exit(1);
@@ -55,17 +69,66 @@ int main (int argc, char **argv) {
 		RobbusNodeList_GetTotalInDataSize(),
 		RobbusNodeList_GetTotalOutDataSize(),
 		10); // TODO: enter correct GPS size
+	// slots of robbus_sync, they move from the config order by its reloads
+	uint32_t generation = RobbusNodeList_ReadLayout();
 
 	uint8_t *inData = malloc(RobbusNodeList_GetTotalInDataSize());
 	uint8_t *outData = malloc(RobbusNodeList_GetTotalOutDataSize());
 
+	if (useSnapshot) {
+		snapshot = RobbusSnapshot_Attach();
+		if (snapshot == NULL) {
+			printf("No snapshot segment, is robbus_sync running?\n");
+			exit(1);
+		}
+		round = malloc(snapshot->size);
+		rounds = calloc(snapshot->busCount, sizeof(uint64_t));
+	}
+
 	while(iterations < 0 || (iterations-- > 0)) {
 		int i;
 
+		if (generation != 0 && RobbusShm_GetLayoutGeneration() != generation) {
+			RobbusNodeList_Delete();
+			RobbusNodeList_Create(configName);
+			generation = RobbusNodeList_ReadLayout();
+			inData = realloc(inData, RobbusNodeList_GetTotalInDataSize());
+			outData = realloc(outData, RobbusNodeList_GetTotalOutDataSize());
+		}
+
 		RobbusShm_Read(ROBBUS_SHM_INPUT_DATA, inData, 0, 
 			RobbusNodeList_GetTotalInDataSize());
-		RobbusShm_Read(ROBBUS_SHM_OUTPUT_DATA, outData, 0, 
-			RobbusNodeList_GetTotalOutDataSize());
+		if (snapshot != NULL) {
+			int bus;
+			// every bus has its own rounds, slots of a bus come from the same one
+			memset(outData, 0, RobbusNodeList_GetTotalOutDataSize());
+			for (bus = 0; bus < snapshot->busCount; bus++) {
+				rounds[bus] = RobbusSnapshot_Read(snapshot, bus, round);
+				if (rounds[bus] == 0)
+					continue;
+				for (i = 0; i < RobbusNodeList_GetNodeCount(); i++) {
+					RobbusNodeList_Descriptor_t *node = RobbusNodeList_GetByIndex(i);
+					if (node->removed || node->busIndex != bus
+						|| node->outDataOffset + node->outDataSize + ROBBUS_NODE_OVERHEAD_OFFSET > snapshot->size)
+						continue;
+					memcpy(outData + node->outDataOffset, round + node->outDataOffset,
+						node->outDataSize + ROBBUS_NODE_OVERHEAD_OFFSET);
+				}
+			}
+		} else if (publishPerNode) {
+			// slot by slot, the writer does not take the semaphore
+			for (i = 0; i < RobbusNodeList_GetNodeCount(); i++) {
+				RobbusNodeList_Descriptor_t *node = RobbusNodeList_GetByIndex(i);
+				if (node->removed)
+					continue;
+				outData[node->outDataOffset] = RobbusShm_ReadSlot(ROBBUS_SHM_OUTPUT_DATA,
+					outData + node->outDataOffset + ROBBUS_NODE_OVERHEAD_OFFSET,
+					node->outDataOffset, node->outDataSize);
+			}
+		} else {
+			RobbusShm_Read(ROBBUS_SHM_OUTPUT_DATA, outData, 0, 
+				RobbusNodeList_GetTotalOutDataSize());
+		}
 
 		printf("i: ");
 		for (i = 0; i < RobbusNodeList_GetTotalInDataSize(); i++)
@@ -73,6 +136,12 @@ int main (int argc, char **argv) {
 		printf("  o: ");
 		for (i = 0; i < RobbusNodeList_GetTotalOutDataSize(); i++)
 			printf("%02x", outData[i]);
+		if (snapshot != NULL) {
+			int bus;
+			printf("  r:");
+			for (bus = 0; bus < snapshot->busCount; bus++)
+				printf(" %llu", (unsigned long long)rounds[bus]);
+		}
 		printf("\n");
 
 		struct timespec delay; /* used for wasting time. */
@@ -81,6 +150,8 @@ int main (int argc, char **argv) {
 		nanosleep(&delay, NULL);
 	}
 
+	free(round);
+	free(rounds);
 	RobbusShm_Delete();
 
 	return 0;
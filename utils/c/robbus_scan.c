@@ -18,30 +18,39 @@
 #include "RobbusNodeList.h"
 #include "RobbusShm.h"
 #include "RobbusComm.h"
+#include "RobbusLog.h"
 
 void printUsage(void) {
 	printf("Robbus node scanner\n");
-	printf("Usage: robbus_scan [-h] [-d device] [-l lower] [-u upper] [-c config]\n");
+	printf("Usage: robbus_scan [-h] [-d device] [-b baudrate] [-l lower] [-u upper] [-t turnaround] [-c config]\n");
 	printf("-h This help message\n");
 	printf("-d Scan given device instead of default /dev/robbus\n");
+	printf("-b Use given baud rate instead of default %lu\n", ROBBUS_DEFAULT_BAUDRATE);
 	printf("-l Scan addresses from lower value (first scanned), default 4\n");
 	printf("-u Scan addresses to upper value (last scanned), default 127\n");
 	printf("-c Use given config file instead of default /etc/robbus/nodes.conf\n");
+	printf("-t Time in us given to a node to start its reply (default %lu)\n", ROBBUS_DEFAULT_TURNAROUND_US);
 }
 
 int main (int argc, char **argv) {
 
 	int opt;
 	char *deviceName = ROBBUS_DEFAULT_DEVICE;
+	unsigned long baudRate = ROBBUS_DEFAULT_BAUDRATE;
 	char *configName = ROBBUS_DEFAULT_NODE_LIST_CONFIG;
 	uint8_t lowerLimit = 4;
 	uint8_t upperLimit = 127;	
+	unsigned long turnaround = ROBBUS_DEFAULT_TURNAROUND_US;
+	RobbusComm_t *comm;
 
-	while ((opt=getopt(argc, argv, "hd:c:l:u:")) != -1) {
+	while ((opt=getopt(argc, argv, "hd:b:c:l:u:t:")) != -1) {
 		switch (opt) {
 			case 'd':
 				deviceName = optarg;
 				break;
+			case 'b':
+				baudRate = strtoul(optarg, NULL, 10);
+				break;
 			case 'c':
 				configName = optarg;
 				break;
@@ -51,6 +60,9 @@ int main (int argc, char **argv) {
 			case 'u': 
 				upperLimit = atoi(optarg);
 				break;
+			case 't':
+				turnaround = strtoul(optarg, NULL, 10);
+				break;
 			default:
 				printUsage();
 				exit(1);
@@ -66,22 +78,30 @@ int main (int argc, char **argv) {
 
 	uint8_t inData[] = {'d'}; // "describe" packet
 	uint8_t outData[2];
-	RobbusComm_Create(deviceName);
+	comm = RobbusComm_Open(deviceName, baudRate);
+	if (comm == NULL) {
+		printf("Unable to open %s\n", deviceName);
+		exit(1);
+	}
+	RobbusComm_SetTurnaround(comm, turnaround);
 	
-	printf("Scanning Robbus:\n");
+	RobbusLog_Start(stdout);
+	RobbusLog_Attach(deviceName);
+	RobbusLog_Info("Scanning Robbus");
 	for (i = lowerLimit; i <= upperLimit; i++) {
-		RobbusComm_SendData(1, i, inData, 1);
-		int ret = RobbusComm_ReceiveData(1, i, outData, 2);
+		RobbusComm_SendData(comm, 1, i, inData, 1);
+		int ret = RobbusComm_ReceiveData(comm, 1, i, outData, 2);
 
 		if (ret == RBC_SUCCESS) {
-			printf("Found node %d with indata %d and outdata %d\n", 
+			RobbusLog_Info("Found node %ld with indata %ld and outdata %ld", 
 				i, outData[0], outData[1]);
 		} else if (ret != RBC_TIMEOUT) {
-			printf ("Incorrect reply from node %d (error code %d)\n", i, ret);
+			RobbusLog_Warning("Incorrect reply from node %ld (error code %ld)", i, ret);
 		}
 
 	}
-	RobbusComm_Close();
+	RobbusLog_Stop();
+	RobbusComm_Close(comm);
 
 	RobbusNodeList_Delete();
 	return 0;
@@ -18,12 +18,18 @@
 
 #include "RobbusShm.h"
 #include "RobbusNodeList.h"
+#include "RobbusComm.h"
+#include "RobbusCommand.h"
+
+/// how long the reply to priority command is waited for
+#define SET_COMMAND_TIMEOUT_US 1000000ULL
 
 void printUsage(void) {
 	printf("Robbus data setting tool\n");
-	printf("Usage: robbus_set [-h] [-c config] address data\n");
+	printf("Usage: robbus_set [-h] [-u] [-c config] address data\n");
 	printf("-h This help message\n");
 	printf("-c Use given config file instead of default /etc/robbus/nodes.conf\n");
+	printf("-u Send the data at once by priority command of robbus_sync and print the reply\n");
 	printf("address decimal node address\n");
 	printf("data data to set as hex string i.e. 45a35b\n");
 }
@@ -40,12 +46,16 @@ int main (int argc, char **argv) {
 
 		int opt;
 	char *configName = ROBBUS_DEFAULT_NODE_LIST_CONFIG;
+	int urgent = 0;
 
-	while ((opt=getopt(argc, argv, "hc:")) != -1) {
+	while ((opt=getopt(argc, argv, "huc:")) != -1) {
 		switch (opt) {
 			case 'c':
 				configName = optarg;
 				break;
+			case 'u':
+				urgent = 1;
+				break;
 			default:
 				printUsage();
 				exit(1);
@@ -90,6 +100,12 @@ int main (int argc, char **argv) {
 		RobbusNodeList_GetTotalInDataSize(),
 		RobbusNodeList_GetTotalOutDataSize(),
 		10); // TODO: enter correct GPS size
+	// slot robbus_sync uses, it moves from the config order by its reloads
+	RobbusNodeList_ReadLayout();
+	if (node->removed) {
+		printf("Node not synced by robbus_sync\n");
+		exit(1);
+	}
 
 	uint8_t *inData = malloc(RobbusNodeList_GetTotalInDataSize());
 
@@ -103,6 +119,33 @@ int main (int argc, char **argv) {
 	RobbusShm_Write(ROBBUS_SHM_INPUT_DATA, inData, 0, 
 		RobbusNodeList_GetTotalInDataSize());
 
+	// input written above keeps the next rounds from sending the old data
+	if (urgent) {
+		RobbusCommand_Queue_t *commands = RobbusCommand_Attach();
+		uint8_t reply[ROBBUS_COMMAND_DATA_SIZE], replySize = 0;
+		struct timespec now;
+		int ret;
+
+		if (commands == NULL) {
+			printf("No command queue, is robbus_sync running?\n");
+			exit(1);
+		}
+		ret = RobbusCommand_Submit(commands, node->busIndex, address, data, dataSize);
+		if (ret >= 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			ret = RobbusCommand_Wait(commands, ret, reply, &replySize,
+				now.tv_sec * 1000000ULL + now.tv_nsec / 1000 + SET_COMMAND_TIMEOUT_US);
+		}
+		if (ret != RBC_SUCCESS) {
+			printf("Command failed (error %d)\n", ret);
+			exit(1);
+		}
+		printf("Reply: ");
+		for (i = 0; i < replySize; i++)
+			printf("%02x", reply[i]);
+		printf("\n");
+	}
+
 	//RobbusShm_Delete();
 
 	return 0;
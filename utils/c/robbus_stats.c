@@ -0,0 +1,107 @@
+/*!
+* \file robbus_stats.c
+* \brief print transaction and cycle time statistics of running robbus_sync
+*
+* \author Kamil Rezac
+*  URL: http://robotika.cz/
+*
+*  Revision: 1.0
+*  Date: 2009/10/30
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "RobbusComm.h"
+#include "RobbusStats.h"
+
+void printUsage(void) {
+	printf("Robbus statistics tool\n");
+	printf("Usage: robbus_stats [-h] [-i interval]\n");
+	printf("-h This help message\n");
+	printf("-i Print again every given number of seconds\n");
+}
+
+static void printHistogram(const char *name, const RobbusStats_Histogram_t *histogram) {
+	if (histogram->count == 0) {
+		printf("  %-12s no samples\n", name);
+		return;
+	}
+	printf("  %-12s %8llu samples, us: avg %6llu p50 %6llu p90 %6llu p99 %6llu p99.9 %6llu max %6llu\n",
+		name, (unsigned long long)histogram->count,
+		(unsigned long long)(histogram->sumUs / histogram->count),
+		RobbusStats_GetPercentile(histogram, 50.0), RobbusStats_GetPercentile(histogram, 90.0),
+		RobbusStats_GetPercentile(histogram, 99.0), RobbusStats_GetPercentile(histogram, 99.9),
+		(unsigned long long)histogram->maxUs);
+}
+
+static const char *healthNames[] = { "online", "suspect", "offline" };
+
+static void printStats(RobbusStats_Header_t *stats) {
+	unsigned i, nodeCount = __atomic_load_n(&stats->nodeCount, __ATOMIC_ACQUIRE);
+	struct timespec now;
+	unsigned long long nowUs;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	nowUs = now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+
+	for (i = 0; i < stats->busCount; i++) {
+		RobbusStats_Bus_t *bus = RobbusStats_GetBus(stats, i);
+		printf("Bus %s\n", bus->name);
+		printHistogram("round", &bus->cycle);
+	}
+	for (i = 0; i < nodeCount; i++) {
+		RobbusStats_Node_t *node = RobbusStats_GetNode(stats, i);
+		printf("Node %02x on %s: %llu transaction(s), errors: timeout %llu, tag %llu, address %llu,"
+			" length %llu, checksum %llu, other %llu\n",
+			node->address, RobbusStats_GetBus(stats, node->bus)->name,
+			(unsigned long long)node->transactions,
+			(unsigned long long)node->errors[-RBC_TIMEOUT], (unsigned long long)node->errors[-RBC_TAG],
+			(unsigned long long)node->errors[-RBC_ADDRESS], (unsigned long long)node->errors[-RBC_LENGTH],
+			(unsigned long long)node->errors[-RBC_CHECKSUM],
+			(unsigned long long)(node->errors[-RBC_HANDLE] + node->errors[-RBC_COLLISION] + node->errors[-RBC_RESYNC]));
+		printf("  %s", node->health <= ROBBUS_STATS_OFFLINE ? healthNames[node->health] : "unknown");
+		if (node->lastReplyUs)
+			printf(", last reply %llu ms ago", (nowUs - (unsigned long long)node->lastReplyUs) / 1000);
+		if (node->probes)
+			printf(", %llu probe(s)", (unsigned long long)node->probes);
+		printf("\n");
+		printHistogram("first byte", &node->firstByte);
+		printHistogram("transaction", &node->transaction);
+	}
+}
+
+int main (int argc, char **argv) {
+
+	int opt;
+	int interval = 0;
+	RobbusStats_Header_t *stats;
+
+	while ((opt=getopt(argc, argv, "hi:")) != -1) {
+		switch (opt) {
+			case 'i':
+				interval = atoi(optarg);
+				break;
+			default:
+				printUsage();
+				exit(1);
+		}
+	}
+
+	stats = RobbusStats_Attach();
+	if (stats == NULL) {
+		printf("No statistics, is robbus_sync running?\n");
+		exit(1);
+	}
+
+	printStats(stats);
+	while (interval > 0) {
+		sleep(interval);
+		printf("\n");
+		printStats(stats);
+	}
+	return 0;
+}
@@ -9,100 +9,880 @@
 *  Date: 2009/10/30
 */
 
+#define _GNU_SOURCE /* pthread_setaffinity_np() */
+
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
 
 #include "RobbusNodeList.h"
 #include "RobbusShm.h"
 #include "RobbusComm.h"
+#include "RobbusFrame.h"
+#include "RobbusSched.h"
+#include "RobbusLog.h"
+#include "RobbusStats.h"
+#include "RobbusCommand.h"
+#include "RobbusSnapshot.h"
+
+/// how often achieved node rates are printed
+#define SYNC_REPORT_INTERVAL_US 10000000ULL
+
+/// stack touched by real-time threads before their loop, so it does not fault later
+#define SYNC_STACK_PREFAULT_SIZE (64 * 1024)
+#define SYNC_MAX_CPUS 64
+
+/// room left in the data segments for nodes added by reload
+#define SYNC_DEFAULT_SPARE_SIZE 256
+
+/// timeouts in a row after which a node is only probed
+#define SYNC_DEFAULT_SUSPECT_TIMEOUTS 3
+/// probe interval of a node which stopped replying, doubled after each failed probe
+#define SYNC_PROBE_MIN_US 100000ULL
+#define SYNC_PROBE_MAX_US 10000000ULL
 
 void printUsage(void) {
 	printf("Robbus data synchronizing tool\n");
-	printf("Usage: robbus_sync [-h] [-d device] [-i iterations] [-c config]\n");
+	printf("Usage: robbus_sync [-h] [-z] [-d device] [-b baudrate] [-i iterations] [-t turnaround] [-c config] [-v level]\n");
+	printf("                   [-s spare] [-f timeouts]\n");
+	printf("                   [-p cycle] [-r priority] [-a cpus] [-m]\n");
 	printf("-h This help message\n");
 	printf("-d Sync given device instead of default /dev/robbus\n");
+	printf("   (nodes with bus=device in the config are synced on that device)\n");
+	printf("   other node options: group=address/mask for writing equal data by one\n");
+	printf("   group packet (groupread=1 if the members reply to it in time slots),\n");
+	printf("   multi=1 for writing several nodes by one packet (their output is not\n");
+	printf("   read then and is marked invalid), delta=1 for sending input and output\n");
+	printf("   only when they change, period=us for syncing the node at that rate\n");
+	printf("   (earliest deadline first) instead of every round\n");
+	printf("-b Use given baud rate instead of default %lu\n", ROBBUS_DEFAULT_BAUDRATE);
 	printf("-i Run only given number of iterations (default unlimited)\n");
 	printf("-c Use given config file instead of default /etc/robbus/nodes.conf\n");
+	printf("   SIGHUP reloads it, nodes keep their memory slots and new ones get spare space\n");
+	printf("-s Spare bytes in input and output memory for nodes added by reload (default %d)\n",
+		SYNC_DEFAULT_SPARE_SIZE);
+	printf("-t Longest time in us given to a node to start its reply (default %lu),\n", ROBBUS_DEFAULT_TURNAROUND_US);
+	printf("   nodes which replied get less by their measured turnaround\n");
+	printf("-z Per node publish: copy each node into the output memory on its own, without\n");
+	printf("   the semaphore, as soon as its reply is checked (read it by RobbusShm_ReadSlot())\n");
+	printf("-v Log level: 0 errors, 1 warnings, 2 rates of nodes (default), 3 every transaction\n");
+	printf("-f Timeouts in a row after which a node is only probed by echo at growing\n");
+	printf("   intervals until it replies again (default %d, 0 never)\n", SYNC_DEFAULT_SUSPECT_TIMEOUTS);
+	printf("real-time mode:\n");
+	printf("-p Start rounds at fixed cycle of given us instead of running free\n");
+	printf("-r Run bus threads with given SCHED_FIFO priority\n");
+	printf("-a Pin bus threads to given comma separated CPUs (one per bus, reused round robin)\n");
+	printf("-m Lock memory with mlockall() and prefault the thread stacks and buffers\n");
 }
 
 
-int main (int argc, char **argv) {
+/// nodes written together by one group packet
+typedef struct {
+	uint8_t		address;
+	uint8_t		mask;
+	int		memberCount;
+	int		*members;	//! indices to the bus node array
+	uint8_t		slotWidth;	//! members reply to group read in slots of this width, 0 for group writes
+	int		slots;		//! slots up to the last member
+	uint8_t		replySize;	//! longest member output
+} SyncGroup_t;
 
-	uint8_t i;
-	int opt;
-	char *deviceName = ROBBUS_DEFAULT_DEVICE;
-	char *configName = ROBBUS_DEFAULT_NODE_LIST_CONFIG;
-	int iterations = -1;
+/// timing of fixed cycle rounds
+typedef struct {
+	unsigned long long nextUs;	//! planned start of the next cycle, 0 before the first
+	unsigned long long startUs;	//! actual start of the current cycle
+	unsigned long	cycles;
+	unsigned long	overruns;	//! rounds which ran over the next cycle start
+	unsigned long long jitterSumUs;	//! actual minus planned cycle start
+	unsigned long	jitterMaxUs;
+	unsigned long	cycleMaxUs;	//! longest round
+} SyncCycleStats_t;
 
-	while ((opt=getopt(argc, argv, "hd:c:i:")) != -1) {
-		switch (opt) {
-			case 'd':
-				deviceName = optarg;
+/// whether a node replies
+typedef struct {
+	int		health;		//! ROBBUS_STATS_ONLINE, _SUSPECT or _OFFLINE
+	int		timeouts;	//! in a row
+	unsigned long long probeIntervalUs;
+	unsigned long long nextProbeUs;
+} SyncHealth_t;
+
+/// one bus segment, synced by its own thread
+typedef struct SyncBus {
+	const char	*deviceName;
+	RobbusComm_t	*comm;
+	pthread_t	thread;
+	int		iterations;
+	int		publishPerNode;	//! checked replies are copied to their shared slot at once
+	size_t		inDataSize;	//! shared memory sizes, the local copies take the same
+	size_t		outDataSize;
+	int		nodeCapacity;	//! most nodes the bus may get by reload
+	struct SyncBus	*reload;	//! node set built by reload until the bus thread takes it
+	int		running;	//! bus thread has not ended, only such take reloads
+	RobbusCommand_Queue_t *commandQueue;
+	RobbusCommand_Ring_t *commands;	//! priority commands for the bus, NULL without ring
+	int		suspectTimeouts; //! timeouts making a node suspect, 0 to keep syncing it
+	// node set, replaced as a whole by reload
+	int		nodeCount;
+	RobbusNodeList_Descriptor_t **nodes;
+	int		groupCount;
+	SyncGroup_t	*groups;
+	RobbusComm_ChangeState_t **changeStates;	//! per node, only for delta=1 nodes
+	SyncHealth_t	*health;	//! per node
+	RobbusSched_t	*sched;		//! task per node
+	unsigned long	cyclePeriodUs;	//! fixed cycle, 0 to run free
+	SyncCycleStats_t cycle;
+	int		priority;	//! SCHED_FIFO priority, 0 for normal scheduling
+	int		cpu;		//! CPU to run on, -1 for any
+	int		prefault;	//! touch the stack and local buffers before the loop
+	RobbusStats_Bus_t *stats;	//! NULL without stats segment
+	RobbusStats_Node_t **nodeStats;	//! NULL without stats segment, records NULL when it is full
+	RobbusSnapshot_Header_t *snapshot;	//! NULL without snapshot segment
+	int		index;		//! of the bus in the stats, command and snapshot segments
+} SyncBus_t;
+
+/// what the thread reloading config needs
+typedef struct {
+	SyncBus_t	*buses;
+	int		busCount;
+	const char	*configName;
+	const char	*deviceName;	//! bus of nodes without bus option
+	size_t		inDataSize;
+	size_t		outDataSize;
+	RobbusStats_Header_t *stats;
+} SyncReload_t;
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief find bus with given device or add a new one
+*/
+static SyncBus_t *getBus(SyncBus_t *buses, int *busCount, const char *deviceName) {
+	int i;
+	for (i = 0; i < *busCount; i++) {
+		if (strcmp(buses[i].deviceName, deviceName) == 0)
+			return &buses[i];
+	}
+	memset(&buses[*busCount], 0, sizeof(SyncBus_t));
+	buses[*busCount].deviceName = deviceName;
+	buses[*busCount].nodes = malloc(RobbusNodeList_GetNodeCount() * sizeof(RobbusNodeList_Descriptor_t*));
+	return &buses[(*busCount)++];
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief read group members by group packets if all of them reply to it
+*/
+static void setupGroupRead(SyncBus_t *bus, SyncGroup_t *group) {
+	int i;
+
+	group->slotWidth = 0;
+	group->slots = 0;
+	group->replySize = 0;
+	for (i = 0; i < group->memberCount; i++) {
+		RobbusNodeList_Descriptor_t *node = bus->nodes[group->members[i]];
+		int slot = (node->address & ~group->mask & 0x7f) + 1;
+		if (!node->groupRead || node->inDataSize >= 0xff)
+			return;
+		if (slot > group->slots)
+			group->slots = slot;
+		if (node->outDataSize > group->replySize)
+			group->replySize = node->outDataSize;
+	}
+	if (group->memberCount == 0)
+		return;
+
+	group->slotWidth = RobbusComm_GetSlotWidth(bus->comm, group->replySize);
+	if (group->slotWidth == 0)
+		printf("Group %02x/%02x on %s: replies too long for time slots, group reads disabled\n",
+			group->address, group->mask, bus->deviceName);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief track replies of a node, timeouts in a row make it suspect
+*/
+static void recordHealth(SyncBus_t *bus, int i, int result) {
+	SyncHealth_t *health = &bus->health[i];
+	RobbusStats_Node_t *stats = bus->nodeStats != NULL ? bus->nodeStats[i] : NULL;
+
+	if (result == RBC_SUCCESS) {
+		health->timeouts = 0;
+		if (stats != NULL)
+			RobbusStats_SetLastReply(stats, RobbusSched_Now());
+		return;
+	}
+	if (result != RBC_TIMEOUT || bus->suspectTimeouts == 0 || ++health->timeouts < bus->suspectTimeouts)
+		return;
+	health->health = ROBBUS_STATS_SUSPECT;
+	health->probeIntervalUs = SYNC_PROBE_MIN_US;
+	health->nextProbeUs = RobbusSched_Now() + SYNC_PROBE_MIN_US;
+	if (stats != NULL)
+		RobbusStats_SetHealth(stats, health->health);
+	RobbusLog_Warning("Node %02lx: %ld timeouts in a row, only probed now", bus->nodes[i]->address, health->timeouts);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief echo node which stopped replying once its probe interval elapsed
+*
+* The interval doubles after each failed probe, the node is offline when
+* it reaches SYNC_PROBE_MAX_US. Node which replies is synced again, change
+* only ones from full data (they may have been restarted).
+*/
+static void probeNode(SyncBus_t *bus, int i) {
+	SyncHealth_t *health = &bus->health[i];
+	RobbusStats_Node_t *stats = bus->nodeStats != NULL ? bus->nodeStats[i] : NULL;
+	int ret;
+
+	if (RobbusSched_Now() < health->nextProbeUs)
+		return;
+	ret = RobbusComm_Echo(bus->comm, bus->nodes[i]->address);
+	if (ret == RBC_SUCCESS) {
+		health->health = ROBBUS_STATS_ONLINE;
+		health->timeouts = 0;
+		if (bus->changeStates[i] != NULL)
+			RobbusComm_ChangeStateInit(bus->changeStates[i]);
+		RobbusLog_Info("Node %02lx: replies again", bus->nodes[i]->address);
+	} else {
+		health->probeIntervalUs *= 2;
+		if (health->probeIntervalUs >= SYNC_PROBE_MAX_US) {
+			health->probeIntervalUs = SYNC_PROBE_MAX_US;
+			if (health->health != ROBBUS_STATS_OFFLINE)
+				RobbusLog_Warning("Node %02lx: offline", bus->nodes[i]->address);
+			health->health = ROBBUS_STATS_OFFLINE;
+		}
+		health->nextProbeUs = RobbusSched_Now() + health->probeIntervalUs;
+	}
+	if (stats != NULL) {
+		RobbusStats_CountProbe(stats);
+		RobbusStats_SetHealth(stats, health->health);
+	}
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief copy node output of the local copy into its shared slot, for -z
+*
+* Replies are decoded into the local copy, not into the slot, so readers
+* of the slot wait only during this copy, never during the reply.
+*/
+static void publishSlot(RobbusNodeList_Descriptor_t *node, uint8_t *outData) {
+	uint8_t *outValid = outData + node->outDataOffset;
+	uint8_t *slot = RobbusShm_BeginSlotWrite(ROBBUS_SHM_OUTPUT_DATA, node->outDataOffset);
+
+	if (*outValid)
+		memcpy(slot, outValid + ROBBUS_NODE_OVERHEAD_OFFSET, node->outDataSize);
+	RobbusShm_EndSlotWrite(ROBBUS_SHM_OUTPUT_DATA, node->outDataOffset, *outValid);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief store replies to group read packet into the output of members
+*
+* \param done set for members which replied
+* \return number of replies
+*/
+static int receiveGroupReplies(SyncBus_t *bus, SyncGroup_t *group, uint8_t *outData, uint8_t *done) {
+	uint8_t reply[0xff];
+	int replies = 0, i, ret;
+
+	do {
+		uint8_t address, size = sizeof(reply);
+
+		ret = RobbusComm_ReceiveGroupReply(bus->comm, &address, reply, &size);
+		if (ret != RBC_SUCCESS)
+			continue;
+		for (i = 0; i < group->memberCount; i++) {
+			RobbusNodeList_Descriptor_t *node = bus->nodes[group->members[i]];
+			uint8_t *outValid = outData + node->outDataOffset;
+
+			if (node->address != address || done[group->members[i]] || node->outDataSize != size)
+				continue;
+			memcpy(outValid + ROBBUS_NODE_OVERHEAD_OFFSET, reply, size);
+			*outValid = 1;
+			if (bus->publishPerNode)
+				publishSlot(node, outData);
+			done[group->members[i]] = 1;
+			recordHealth(bus, group->members[i], RBC_SUCCESS);
+			replies++;
+		}
+	} while (ret != RBC_TIMEOUT && replies < group->memberCount);
+
+	return replies;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief collect group packets the bus nodes declare
+*
+* Group is refused when its packet would reach a configured node which
+* is not its member, that node would take foreign data.
+*/
+static void createGroups(SyncBus_t *bus) {
+	int i, j;
+
+	bus->groups = calloc(bus->nodeCount, sizeof(SyncGroup_t));
+	for (i = 0; i < bus->nodeCount; i++) {
+		RobbusNodeList_Descriptor_t *node = bus->nodes[i];
+		SyncGroup_t *group = NULL;
+
+		if (!node->groupEnabled)
+			continue;
+		for (j = 0; j < bus->groupCount; j++) {
+			if (bus->groups[j].address == node->groupAddress && bus->groups[j].mask == node->groupMask)
+				group = &bus->groups[j];
+		}
+		if (group == NULL) {
+			group = &bus->groups[bus->groupCount++];
+			group->address = node->groupAddress;
+			group->mask = node->groupMask;
+			group->members = malloc(bus->nodeCount * sizeof(int));
+		}
+		group->members[group->memberCount++] = i;
+	}
+
+	for (j = 0; j < bus->groupCount; j++) {
+		SyncGroup_t *group = &bus->groups[j];
+		for (i = 0; i < bus->nodeCount; i++) {
+			RobbusNodeList_Descriptor_t *node = bus->nodes[i];
+			if ((node->address & group->mask) == (group->address & group->mask)
+				&& !(node->groupEnabled && node->groupAddress == group->address
+					&& node->groupMask == group->mask)) {
+				printf("Group %02x/%02x on %s also matches node %02x, group writes disabled\n",
+					group->address, group->mask, bus->deviceName, node->address);
+				group->memberCount = 0;
 				break;
-			case 'c':
-				configName = optarg;
+			}
+		}
+		setupGroupRead(bus, group);
+	}
+}
+
+/// index of the node holding the same slots in another node set, -1 if none
+static int findSlot(const SyncBus_t *bus, const RobbusNodeList_Descriptor_t *node) {
+	int i;
+	for (i = 0; i < bus->nodeCount; i++) {
+		if (bus->nodes[i]->inDataOffset == node->inDataOffset && bus->nodes[i]->outDataOffset == node->outDataOffset)
+			return i;
+	}
+	return -1;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief build groups, change states, scheduler and stats records of the bus nodes
+*
+* Nodes keeping their slots from the previous node set keep its change
+* state and health, stats records are kept by node address.
+*
+* \param stats NULL without stats segment
+* \param previous set replaced by reload, NULL at start
+* \return 0, 1 if the scheduler was not created
+*/
+static int setupBusNodes(SyncBus_t *bus, RobbusStats_Header_t *stats, int index, const SyncBus_t *previous) {
+	unsigned long *periods = malloc((bus->nodeCount + 1) * sizeof(unsigned long));
+	int j, k;
+
+	createGroups(bus);
+	bus->changeStates = calloc(bus->nodeCount, sizeof(RobbusComm_ChangeState_t*));
+	bus->health = calloc(bus->nodeCount, sizeof(SyncHealth_t));
+	if (stats != NULL)
+		bus->nodeStats = calloc(bus->nodeCount, sizeof(RobbusStats_Node_t*));
+	for (j = 0; j < bus->nodeCount; j++) {
+		RobbusNodeList_Descriptor_t *node = bus->nodes[j];
+		k = previous != NULL ? findSlot(previous, node) : -1;
+		if (k >= 0)
+			bus->health[j] = previous->health[k];
+		if (node->changeOnly) {
+			if (k >= 0 && previous->changeStates[k] != NULL) {
+				bus->changeStates[j] = previous->changeStates[k];
+			} else {
+				bus->changeStates[j] = malloc(sizeof(RobbusComm_ChangeState_t));
+				RobbusComm_ChangeStateInit(bus->changeStates[j]);
+			}
+		}
+		if (bus->nodeStats != NULL) {
+			// node coming back after reload continues its record
+			bus->nodeStats[j] = RobbusStats_FindNode(stats, node->address, index);
+			if (bus->nodeStats[j] == NULL)
+				bus->nodeStats[j] = RobbusStats_AddNode(stats, node->address, index);
+			if (bus->nodeStats[j] == NULL)
+				printf("Node %02x: no stats record left, it is synced without\n", node->address);
+		}
+		periods[j] = node->periodUs;
+	}
+	bus->sched = RobbusSched_Create(bus->nodeCount, periods);
+	free(periods);
+	return bus->sched == NULL;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief free node set of a bus
+*
+* \param current set which took over change states, NULL to free them all
+*/
+static void freeBusNodes(SyncBus_t *bus, const SyncBus_t *current) {
+	int i, j;
+
+	for (j = 0; j < bus->groupCount; j++)
+		free(bus->groups[j].members);
+	free(bus->groups);
+	for (j = 0; j < bus->nodeCount; j++) {
+		for (i = 0; current != NULL && i < current->nodeCount; i++) {
+			if (current->changeStates[i] == bus->changeStates[j])
 				break;
-			case 'i':
-				iterations = atoi(optarg);
+		}
+		if (current == NULL || i == current->nodeCount)
+			free(bus->changeStates[j]);
+	}
+	free(bus->changeStates);
+	free(bus->health);
+	if (bus->sched != NULL)
+		RobbusSched_Destroy(bus->sched);
+	free(bus->nodeStats);
+	free(bus->nodes);
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief write group by one packet if all members wait for the same data
+*
+* Members of group read reply in their slots, the ones which did not
+* reply are left to their own transaction.
+*
+* \param done set for members which need no own transaction then
+* \return 1 if the group packet was sent
+*/
+static int syncGroup(SyncBus_t *bus, SyncGroup_t *group, uint8_t *inData, uint8_t *outData, uint8_t *done) {
+	RobbusNodeList_Descriptor_t *first;
+	uint8_t *firstData;
+	int i;
+
+	if (group->memberCount < 2)
+		return 0;
+
+	first = bus->nodes[group->members[0]];
+	firstData = inData + first->inDataOffset;
+	for (i = 0; i < group->memberCount; i++) {
+		RobbusNodeList_Descriptor_t *node = bus->nodes[group->members[i]];
+		uint8_t *nodeData = inData + node->inDataOffset;
+		// valid flag is compared as well
+		if (!*nodeData || node->inDataSize != first->inDataSize
+			|| memcmp(nodeData, firstData, first->inDataSize + ROBBUS_NODE_OVERHEAD_OFFSET) != 0)
+			return 0;
+	}
+
+	if (group->slotWidth) {
+		int replies;
+		if (RobbusComm_SendGroupRead(bus->comm, group->address, group->mask, group->slotWidth, group->slots,
+			group->replySize, firstData + ROBBUS_NODE_OVERHEAD_OFFSET, first->inDataSize) != 0) {
+			RobbusLog_Warning("Group %02lx/%02lx read failed", group->address, group->mask);
+			return 0;
+		}
+		replies = receiveGroupReplies(bus, group, outData, done);
+		RobbusLog_Debug("Group %02lx/%02lx read (%ld of %ld nodes)", group->address, group->mask,
+			replies, group->memberCount);
+		return replies > 0;
+	}
+
+	if (RobbusComm_SendGroupData(bus->comm, group->address, group->mask,
+		firstData + ROBBUS_NODE_OVERHEAD_OFFSET, first->inDataSize) != 0) {
+		RobbusLog_Warning("Group %02lx/%02lx send failed", group->address, group->mask);
+		return 0;
+	}
+	RobbusLog_Debug("Group %02lx/%02lx synced (%ld nodes)", group->address, group->mask, group->memberCount);
+	for (i = 0; i < group->memberCount; i++)
+		done[group->members[i]] = 1;
+	return 1;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief write valid input of multi=1 nodes by as few multi node packets as possible
+*
+* Nodes do not reply to multi node packets, so the output of written
+* nodes is marked invalid instead of keeping a reply nobody checks.
+*
+* \param done set for written nodes, they need no own transaction
+* \return number of nodes written
+*/
+static int syncMulti(SyncBus_t *bus, uint8_t *inData, uint8_t *outData, uint8_t *done) {
+	uint8_t frame[ROBBUS_FRAME_MAX_SIZE];
+	int sections[ROBBUS_MULTI_BODY_MAX / ROBBUS_MULTI_SECTION_OVERHEAD];
+	int next = 0, i, written = 0;
+
+	while (next < bus->nodeCount) {
+		RobbusFrame_Builder_t builder;
+		size_t body = 0;
+		int count = 0;
+
+		// nodes fitting into one packet
+		for (; next < bus->nodeCount; next++) {
+			RobbusNodeList_Descriptor_t *node = bus->nodes[next];
+			size_t section = ROBBUS_MULTI_SECTION_OVERHEAD + node->inDataSize;
+			if (!node->multiWrite || done[next] || !inData[node->inDataOffset]
+				|| section > ROBBUS_MULTI_BODY_MAX)
+				continue;
+			if (body + section > ROBBUS_MULTI_BODY_MAX)
 				break;
-			default:
-				printUsage();
-				exit(1);
+			body += section;
+			sections[count++] = next;
+		}
+		if (count == 0)
+			break;
+
+		RobbusFrame_BeginMulti(&builder, frame, body);
+		for (i = 0; i < count; i++) {
+			RobbusNodeList_Descriptor_t *node = bus->nodes[sections[i]];
+			RobbusFrame_PutSection(&builder, node->address,
+				inData + node->inDataOffset + ROBBUS_NODE_OVERHEAD_OFFSET, node->inDataSize);
+		}
+		if (RobbusComm_SendFrame(bus->comm, frame, RobbusFrame_End(&builder)) != RBC_SUCCESS) {
+			RobbusLog_Warning("Multi write of %ld nodes failed", count); // nodes are tried one by one
+			continue;
 		}
+		RobbusLog_Debug("Multi write synced (%ld nodes)", count);
+		for (i = 0; i < count; i++) {
+			RobbusNodeList_Descriptor_t *node = bus->nodes[sections[i]];
+			outData[node->outDataOffset] = 0;
+			if (bus->publishPerNode)
+				publishSlot(node, outData);
+			done[sections[i]] = 1;
+		}
+		written += count;
 	}
-	
-	printf("Syncing robbus device %s (config %s)\n", 
-		deviceName, configName);		
+	return written;
+}
 
-	// read list of nodes
-	RobbusNodeList_Create(configName);
-	RobbusNodeList_PrintList();
+///////////////////////////////////////////////////////////
+/*!
+* \brief print achieved rate and missed deadlines of the bus nodes
+*/
+static void reportSchedule(SyncBus_t *bus) {
+	unsigned long long now = RobbusSched_Now();
+	int i;
+
+	for (i = 0; i < bus->nodeCount; i++) {
+		const RobbusSched_Task_t *task = RobbusSched_GetTask(bus->sched, i);
+		// rates in tenths of Hz, log records take integers only
+		long rate = RobbusSched_GetRate(bus->sched, i, now) * 10.0 + 0.5;
+		if (task->periodUs)
+			RobbusLog_Info("Node %02lx: %ld.%ld Hz (target %ld.%ld Hz), %ld deadline(s) missed",
+				bus->nodes[i]->address, rate / 10, rate % 10,
+				10000000L / task->periodUs / 10, 10000000L / task->periodUs % 10, task->missed);
+		else
+			RobbusLog_Info("Node %02lx: %ld.%ld Hz", bus->nodes[i]->address, rate / 10, rate % 10);
+	}
+	if (bus->cyclePeriodUs && bus->cycle.cycles)
+		RobbusLog_Info("Cycle %ld us: %ld cycle(s), %ld overrun(s), start jitter avg %ld max %ld us, worst round %ld us",
+			bus->cyclePeriodUs, bus->cycle.cycles, bus->cycle.overruns,
+			(long)(bus->cycle.jitterSumUs / bus->cycle.cycles), bus->cycle.jitterMaxUs, bus->cycle.cycleMaxUs);
+}
+
+/// touch every page of the buffer, its content is kept
+static void prefault(void *buffer, size_t size) {
+	volatile uint8_t *bytes = buffer;
+	size_t page = sysconf(_SC_PAGESIZE), i;
+
+	for (i = 0; i < size; i += page)
+		bytes[i] = bytes[i];
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief touch the stack below the caller, one byte per page
+*
+* Not inlined, so the array lies where the frames of deeper calls will.
+* Stores go through the volatile array and cannot be left out.
+*/
+static void __attribute__((noinline)) prefaultStack(void) {
+	volatile uint8_t stack[SYNC_STACK_PREFAULT_SIZE];
+	size_t page = sysconf(_SC_PAGESIZE), i;
+
+	for (i = 0; i < sizeof(stack); i += page)
+		stack[i] = 0;
+}
 
-	// create shared memory
-	RobbusShm_Create(
-		RobbusNodeList_GetTotalInDataSize(),
-		RobbusNodeList_GetTotalOutDataSize(),
-		10); // TODO: enter correct GPS size
+///////////////////////////////////////////////////////////
+/*!
+* \brief apply real-time settings to the calling bus thread
+*
+* Settings which fail are reported and left out.
+*/
+static void setupRealTime(SyncBus_t *bus) {
+	int ret;
+
+	if (bus->priority > 0) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = bus->priority;
+		ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (ret != 0)
+			RobbusLog_Warning("SCHED_FIFO priority %ld not set (errno %ld)", bus->priority, ret);
+	}
+	if (bus->cpu >= 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(bus->cpu, &cpus);
+		ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		if (ret != 0)
+			RobbusLog_Warning("Pinning to CPU %ld failed (errno %ld)", bus->cpu, ret);
+	}
+	if (bus->prefault)
+		prefaultStack();
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief send queued priority commands at once, between transactions only
+*
+* Command goes to the node the same way as its regular transaction (change
+* only nodes keep their change state), the reply is handed to the submitter
+* only.
+*/
+static void runCommands(SyncBus_t *bus) {
+	RobbusCommand_t command;
+	uint8_t reply[ROBBUS_COMMAND_DATA_SIZE];
+	int i, ret;
+
+	if (bus->commands == NULL)
+		return;
+	while (RobbusCommand_Take(bus->commands, &command)) {
+		RobbusNodeList_Descriptor_t *node;
+		unsigned long long start = RobbusSched_Now();
+
+		for (i = 0; i < bus->nodeCount && bus->nodes[i]->address != command.address; i++)
+			;
+		if (i == bus->nodeCount) {
+			RobbusLog_Warning("Node %02lx: command for a node not on the bus", command.address);
+			RobbusCommand_Complete(bus->commandQueue, command.completion, RBC_ADDRESS, reply, 0);
+			continue;
+		}
+		node = bus->nodes[i];
+		if (command.size != node->inDataSize || node->outDataSize > sizeof(reply)) {
+			RobbusLog_Warning("Node %02lx: command of %ld byte(s) refused", command.address, command.size);
+			RobbusCommand_Complete(bus->commandQueue, command.completion, RBC_LENGTH, reply, 0);
+			continue;
+		}
+
+		if (bus->changeStates[i] != NULL)
+			ret = RobbusComm_SendChanged(bus->comm, bus->changeStates[i], node->address, command.data, command.size);
+		else
+			ret = RobbusComm_SendData(bus->comm, ROBBUS_TAG_REGULAR, node->address, command.data, command.size);
+		if (ret == RBC_SUCCESS && bus->changeStates[i] != NULL)
+			ret = RobbusComm_ReceiveChanged(bus->comm, bus->changeStates[i], node->address, reply, node->outDataSize);
+		else if (ret == RBC_SUCCESS)
+			ret = RobbusComm_ReceiveData(bus->comm, ROBBUS_TAG_REGULAR, node->address, reply, node->outDataSize);
+		if (bus->nodeStats != NULL && bus->nodeStats[i] != NULL) {
+			RobbusStats_CountTransaction(bus->nodeStats[i], ret);
+			if (ret == RBC_SUCCESS)
+				RobbusStats_Record(&bus->nodeStats[i]->transaction, RobbusSched_Now() - start);
+		}
+		RobbusLog_Debug("Node %02lx: command sent (result %ld)", node->address, ret);
+		RobbusCommand_Complete(bus->commandQueue, command.completion, ret, reply,
+			ret == RBC_SUCCESS ? node->outDataSize : 0);
+	}
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief wait for the start of the next fixed cycle
+*
+* Round which ran over the start skips the cycles it missed. Priority
+* commands coming meanwhile are sent at once.
+*/
+static void waitCycle(SyncBus_t *bus) {
+	SyncCycleStats_t *cycle = &bus->cycle;
+	unsigned long long now = RobbusSched_Now(), jitter;
+
+	if (cycle->nextUs == 0) {
+		cycle->nextUs = now;
+	} else {
+		cycle->nextUs += bus->cyclePeriodUs;
+		if (now > cycle->nextUs) {
+			cycle->overruns++;
+			cycle->nextUs += ((now - cycle->nextUs) / bus->cyclePeriodUs + 1) * bus->cyclePeriodUs;
+		}
+	}
+
+	// absolute timeout of the input futex, which submitted commands wake
+	for (;;) {
+		uint32_t sequence = RobbusShm_GetInputSequence();
+		runCommands(bus);
+		if (RobbusSched_Now() >= cycle->nextUs)
+			break;
+		RobbusShm_WaitInput(sequence, cycle->nextUs);
+	}
+
+	cycle->startUs = RobbusSched_Now();
+	jitter = cycle->startUs - cycle->nextUs;
+	cycle->cycles++;
+	cycle->jitterSumUs += jitter;
+	if (jitter > cycle->jitterMaxUs)
+		cycle->jitterMaxUs = jitter;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief switch to the node set built by reload, between rounds only
+*
+* The replaced set goes back to the reloading thread, which frees it.
+*/
+static void takeReload(SyncBus_t *bus) {
+	SyncBus_t *next = __atomic_load_n(&bus->reload, __ATOMIC_ACQUIRE);
+	SyncBus_t previous;
+
+	if (next == NULL)
+		return;
+	reportSchedule(bus); // rates of the replaced scheduler
+	previous = *bus;
+	bus->nodeCount = next->nodeCount;
+	bus->nodes = next->nodes;
+	bus->groupCount = next->groupCount;
+	bus->groups = next->groups;
+	bus->changeStates = next->changeStates;
+	bus->health = next->health;
+	bus->sched = next->sched;
+	bus->nodeStats = next->nodeStats;
+	next->nodeCount = previous.nodeCount;
+	next->nodes = previous.nodes;
+	next->groupCount = previous.groupCount;
+	next->groups = previous.groups;
+	next->changeStates = previous.changeStates;
+	next->health = previous.health;
+	next->sched = previous.sched;
+	next->nodeStats = previous.nodeStats;
+	__atomic_store_n(&bus->reload, NULL, __ATOMIC_RELEASE);
+	RobbusLog_Info("Node set reloaded, %ld node(s)", bus->nodeCount);
+}
 
-	RobbusComm_Create(deviceName);
+///////////////////////////////////////////////////////////
+/*!
+* \brief sync loop of a single bus
+*
+* Each round takes the nodes whose period elapsed, earliest deadline
+* first. When there are none it sleeps until the next release or until
+* a producer notifies new input, which wakes nodes idle for lack of it.
+* Priority commands are sent before every transaction and while waiting.
+* With fixed cycle the rounds start at its multiples instead, every
+* node without period is tried in each of them.
+* Only slots of nodes on this bus are touched in the shared memory,
+* so buses may be synced in parallel. Node set changed by reload is
+* taken before the next round.
+*/
+static void *syncBus(void *arg) {
+	SyncBus_t *bus = arg;
+	int i, k;
+	int iterations = bus->iterations;
+	unsigned long long lastReport = RobbusSched_Now();
+	uint32_t inputSequence = RobbusShm_GetInputSequence();
+	unsigned long long roundStart;
+
+	RobbusLog_Attach(bus->deviceName);
+	setupRealTime(bus);
 
 	// allocate buffers for local data copy
-	void *inData = malloc(RobbusNodeList_GetTotalInDataSize());
-	void *outData = malloc(RobbusNodeList_GetTotalOutDataSize());
+	void *inData = calloc(1, bus->inDataSize);
+	void *outData = calloc(1, bus->outDataSize);
+	uint8_t *written = malloc(bus->nodeCapacity);
+	int *due = malloc(bus->nodeCapacity * sizeof(int));
+	if (bus->prefault) {
+		prefault(inData, bus->inDataSize);
+		prefault(outData, bus->outDataSize);
+		prefault(written, bus->nodeCapacity);
+		prefault(due, bus->nodeCapacity * sizeof(int));
+	}
 	
 	while(iterations < 0 || (iterations-- > 0)) {
+		int dueCount = 0;
+
+		if (bus->cyclePeriodUs) {
+			waitCycle(bus);
+			takeReload(bus);
+			RobbusSched_WakeIdle(bus->sched, bus->cycle.startUs);
+			RobbusSched_Release(bus->sched, bus->cycle.startUs);
+		} else for (;;) {
+			uint32_t sequence = RobbusShm_GetInputSequence();
+			takeReload(bus);
+			runCommands(bus);
+			if (sequence != inputSequence) {
+				inputSequence = sequence;
+				RobbusSched_WakeIdle(bus->sched, RobbusSched_Now());
+			}
+			if (RobbusSched_Release(bus->sched, RobbusSched_Now()) > 0)
+				break;
+			RobbusShm_WaitInput(sequence, RobbusSched_NextRelease(bus->sched));
+		}
+		// nodes not due are left out as if written already
+		memset(written, 1, bus->nodeCount);
+		while ((i = RobbusSched_PopReady(bus->sched)) >= 0) {
+			due[dueCount++] = i;
+			written[i] = 0;
+		}
+		if (dueCount == 0)
+			continue; // cycle with nothing due
+		roundStart = bus->cyclePeriodUs ? bus->cycle.startUs : RobbusSched_Now();
+
 		// create local copy of input data
 		if (RobbusShm_Lock(ROBBUS_SHM_INPUT_DATA) != 0) {
-			perror("Locking input data failed");
+			RobbusLog_Error("Locking input data failed (errno %ld)", errno);
+			for (k = 0; k < dueCount; k++)
+				RobbusSched_Complete(bus->sched, due[k], RobbusSched_Now(), 0);
 			continue;
 		}
 		void* sharedData = RobbusShm_GetPtr(ROBBUS_SHM_INPUT_DATA);
-		memcpy(inData, sharedData, RobbusNodeList_GetTotalInDataSize());
-		// erase valid flags in shared memory (are kept in local copy)
-		for (i = 0; i < RobbusNodeList_GetNodeCount(); i++) {
-			// fetch node descriptor
-			RobbusNodeList_Descriptor_t * node = 
-				RobbusNodeList_GetByIndex(i);
+		for (i = 0; i < bus->nodeCount; i++) {
+			RobbusNodeList_Descriptor_t * node = bus->nodes[i];
 			uint8_t *inValid = ((uint8_t*)sharedData) + node->inDataOffset;
+			if (written[i] || bus->health[i].health != ROBBUS_STATS_ONLINE) {
+				// keeps group and multi packets away from it, input
+				// of node not replying waits until it does
+				*((uint8_t*)inData + node->inDataOffset) = 0;
+				continue;
+			}
+			memcpy(inData + node->inDataOffset, sharedData + node->inDataOffset,
+				node->inDataSize + ROBBUS_NODE_OVERHEAD_OFFSET);
+			// erase valid flags in shared memory (are kept in local copy)
 			*inValid = 0;
 		}
 
 		RobbusShm_Unlock(ROBBUS_SHM_INPUT_DATA);
+		runCommands(bus);
 
-		int atLeastOneSynced = 0;
+		// same data for a whole group go by single packet, output of nodes
+		// written this way is left as it is unless they reply in time slots
+		for (i = 0; i < bus->groupCount; i++)
+			syncGroup(bus, &bus->groups[i], inData, outData, written);
+		// and small payloads of many nodes by packets with sections for each of them
+		syncMulti(bus, inData, outData, written);
 
-		// communicate all nodes
-		for (i = 0; i < RobbusNodeList_GetNodeCount(); i++) {
+		// communicate due nodes
+		for (k = 0; k < dueCount; k++) {
+			runCommands(bus);
 			// fetch node descriptor
-			RobbusNodeList_Descriptor_t * node = 
-				RobbusNodeList_GetByIndex(i);
+			i = due[k];
+			RobbusNodeList_Descriptor_t * node = bus->nodes[i];
+
+			if (bus->health[i].health != ROBBUS_STATS_ONLINE) {
+				probeNode(bus, i);
+				RobbusSched_Complete(bus->sched, i, RobbusSched_Now(), 0);
+				continue;
+			}
+			if (written[i]) {
+				RobbusSched_Complete(bus->sched, i, RobbusSched_Now(), 1);
+				continue;
+			}
+
+			RobbusLog_Debug("Node %02lx: syncing", node->address);
 
-			RobbusNodeList_PrintNode(node);
-			
 			uint8_t *inValid = ((uint8_t*)inData) + node->inDataOffset;
 			if (*inValid) {
 				void *inPayload = inData + node->inDataOffset + ROBBUS_NODE_OVERHEAD_OFFSET;
@@ -110,42 +890,377 @@ int main (int argc, char **argv) {
 				uint8_t *outValid = ((uint8_t*)outData) + node->outDataOffset;
 				*outValid = 0;
 
-				if (RobbusComm_SendData(ROBBUS_TAG_REGULAR, node->address, 
-					inPayload, node->inDataSize) == 0) {
-					if (RobbusComm_ReceiveData(ROBBUS_TAG_REGULAR, node->address, 
-						outPayload, node->outDataSize) == 0) {
-						printf("Node synced\n");
+				RobbusComm_ChangeState_t *changeState = bus->changeStates[i];
+				unsigned long long start = RobbusSched_Now();
+				int ret;
+
+				if (changeState != NULL)
+					ret = RobbusComm_SendChanged(bus->comm, changeState, node->address, inPayload, node->inDataSize);
+				else
+					ret = RobbusComm_SendData(bus->comm, ROBBUS_TAG_REGULAR, node->address, 
+						inPayload, node->inDataSize);
+				if (ret == 0) {
+					if (changeState != NULL)
+						ret = RobbusComm_ReceiveChanged(bus->comm, changeState, node->address,
+							outPayload, node->outDataSize);
+					else
+						ret = RobbusComm_ReceiveData(bus->comm, ROBBUS_TAG_REGULAR, node->address, 
+							outPayload, node->outDataSize);
+					if (ret == 0) {
+						RobbusLog_Debug("Node %02lx synced", node->address);
 						*outValid = 1;
-						atLeastOneSynced = 1;
 					} else {
-						printf("Receive failed\n");
+						RobbusLog_Warning("Node %02lx: receive failed (error %ld)", node->address, ret);
 					}
 				} else {
-					printf("Send failed\n");
+					RobbusLog_Warning("Node %02lx: send failed (error %ld)", node->address, ret);
+				}
+				if (bus->nodeStats != NULL && bus->nodeStats[i] != NULL) {
+					RobbusStats_Node_t *stats = bus->nodeStats[i];
+					RobbusStats_CountTransaction(stats, ret);
+					if (ret == RBC_SUCCESS) {
+						RobbusStats_Record(&stats->transaction, RobbusSched_Now() - start);
+						RobbusStats_Record(&stats->firstByte, RobbusComm_GetFirstByteLatency(bus->comm));
+					}
 				}
+				recordHealth(bus, i, ret);
+				if (bus->publishPerNode)
+					publishSlot(node, outData);
 			} else {
-				printf("InData not valid\n");
+				RobbusLog_Debug("Node %02lx: input not valid", node->address);
 			}
+			RobbusSched_Complete(bus->sched, i, RobbusSched_Now(), *inValid);
 		}
 
-		// and write back the output data into shared memory
-		RobbusShm_Write(ROBBUS_SHM_OUTPUT_DATA, outData, 0, 
-			RobbusNodeList_GetTotalOutDataSize());
+		// and write back the output data of this round into shared memory
+		if (bus->publishPerNode) {
+			// already published slot by slot
+		} else if (RobbusShm_Lock(ROBBUS_SHM_OUTPUT_DATA) != 0) {
+			RobbusLog_Error("Locking output data failed (errno %ld)", errno);
+		} else {
+			sharedData = RobbusShm_GetPtr(ROBBUS_SHM_OUTPUT_DATA);
+			for (k = 0; k < dueCount; k++) {
+				RobbusNodeList_Descriptor_t * node = bus->nodes[due[k]];
+				memcpy(sharedData + node->outDataOffset, outData + node->outDataOffset,
+					node->outDataSize + ROBBUS_NODE_OVERHEAD_OFFSET);
+			}
+			RobbusShm_Unlock(ROBBUS_SHM_OUTPUT_DATA);
+		}
+
+		// whole round for readers which must not see a mix of two
+		if (bus->snapshot != NULL && dueCount > 0)
+			RobbusSnapshot_Publish(bus->snapshot, bus->index, outData);
+
+		if (bus->cyclePeriodUs && RobbusSched_Now() - bus->cycle.startUs > bus->cycle.cycleMaxUs)
+			bus->cycle.cycleMaxUs = RobbusSched_Now() - bus->cycle.startUs;
+		if (bus->stats != NULL)
+			RobbusStats_Record(&bus->stats->cycle, RobbusSched_Now() - roundStart);
 
-		if (!atLeastOneSynced) {
-			// wait for a while
-			struct timespec delay; /* used for wasting time. */
-			delay.tv_sec = 0;
-			delay.tv_nsec = 100000000L;
-			nanosleep(&delay, NULL);
+		if (RobbusSched_Now() - lastReport >= SYNC_REPORT_INTERVAL_US) {
+			reportSchedule(bus);
+			lastReport = RobbusSched_Now();
 		}
 	}
+	reportSchedule(bus);
 	// free allocated local buffers
 	free(inData);
 	free(outData);
+	free(written);
+	free(due);
+	// node set is left to reload from now on
+	__atomic_store_n(&bus->running, 0, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+///////////////////////////////////////////////////////////
+/*!
+* \brief merge changed config and hand the new node sets to the bus threads
+*
+* Nodes keep their memory slots, so the segments stay and the buses are
+* synced meanwhile. The layout is published once all buses use it.
+* Buses whose thread has ended keep their node set. When a new set cannot
+* be built, the reload is undone and all buses keep theirs.
+*/
+static void reloadNodes(SyncReload_t *reload) {
+	SyncBus_t *next;
+	int changes, failed = 0, i, j;
+
+	changes = RobbusNodeList_Reload(reload->configName, reload->inDataSize, reload->outDataSize);
+	if (changes <= 0) {
+		printf(changes == 0 ? "Config %s unchanged\n" : "Config %s not reloaded\n", reload->configName);
+		return;
+	}
+
+	next = calloc(reload->busCount, sizeof(SyncBus_t));
+	for (i = 0; i < reload->busCount; i++) {
+		next[i].deviceName = reload->buses[i].deviceName;
+		next[i].comm = reload->buses[i].comm;
+		next[i].nodes = malloc(reload->buses[i].nodeCapacity * sizeof(RobbusNodeList_Descriptor_t*));
+	}
+	for (j = 0; j < RobbusNodeList_GetNodeCount(); j++) {
+		RobbusNodeList_Descriptor_t *node = RobbusNodeList_GetByIndex(j);
+		const char *deviceName = node->bus[0] ? node->bus : reload->deviceName;
+
+		if (node->removed)
+			continue;
+		for (i = 0; i < reload->busCount && strcmp(next[i].deviceName, deviceName) != 0; i++)
+			;
+		if (i == reload->busCount) {
+			printf("Node %02x: bus %s is not synced, restart to add it\n", node->address, deviceName);
+			continue;
+		}
+		next[i].nodes[next[i].nodeCount++] = node;
+		node->busIndex = i;
+	}
+	for (i = 0; i < reload->busCount; i++) {
+		if (!__atomic_load_n(&reload->buses[i].running, __ATOMIC_ACQUIRE)) {
+			next[i].nodeCount = 0; // nothing to build, the set of the ended thread stays
+			continue;
+		}
+		if (setupBusNodes(&next[i], reload->stats, i, &reload->buses[i]) != 0)
+			failed = 1;
+	}
+	if (failed) {
+		for (i = 0; i < reload->busCount; i++)
+			freeBusNodes(&next[i], &reload->buses[i]);
+		free(next);
+		RobbusNodeList_RestoreRetired();
+		printf("Config %s not reloaded, node sets kept\n", reload->configName);
+		return;
+	}
+
+	// bus threads take them between rounds, waiting ones are woken
+	for (i = 0; i < reload->busCount; i++) {
+		if (next[i].sched != NULL)
+			__atomic_store_n(&reload->buses[i].reload, &next[i], __ATOMIC_RELEASE);
+	}
+	RobbusShm_NotifyInput();
+	for (i = 0; i < reload->busCount; i++) {
+		SyncBus_t *pending = &next[i];
+		while (__atomic_load_n(&reload->buses[i].reload, __ATOMIC_ACQUIRE) != NULL
+			&& __atomic_load_n(&reload->buses[i].running, __ATOMIC_ACQUIRE))
+			usleep(1000);
+		// thread ended before taking it, the new set is freed below instead of the old one
+		__atomic_compare_exchange_n(&reload->buses[i].reload, &pending, NULL, 0,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+	}
+
+	for (i = 0; i < reload->busCount; i++)
+		freeBusNodes(&next[i], &reload->buses[i]);
+	free(next);
+	RobbusNodeList_DeleteRetired();
+	if (RobbusNodeList_PublishLayout() != 0)
+		printf("Layout has room for %d nodes only\n", ROBBUS_SHM_LAYOUT_MAX_NODES);
+	printf("Config %s reloaded, layout generation %u\n", reload->configName, RobbusShm_GetLayoutGeneration());
+	RobbusNodeList_PrintList();
+}
+
+/// reloads config on SIGHUP, blocked in all other threads
+static void *reloadLoop(void *arg) {
+	sigset_t signals;
+	int signal;
+
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGHUP);
+	for (;;) {
+		if (sigwait(&signals, &signal) == 0)
+			reloadNodes(arg);
+	}
+	return NULL;
+}
+
+int main (int argc, char **argv) {
+
+	int i;
+	int opt;
+	char *deviceName = ROBBUS_DEFAULT_DEVICE;
+	unsigned long baudRate = ROBBUS_DEFAULT_BAUDRATE;
+	unsigned long turnaround = ROBBUS_DEFAULT_TURNAROUND_US;
+	char *configName = ROBBUS_DEFAULT_NODE_LIST_CONFIG;
+	int iterations = -1;
+	int publishPerNode = 0;
+	SyncBus_t *buses;
+	int busCount = 0, nodeCapacity;
+	unsigned long spare = SYNC_DEFAULT_SPARE_SIZE;
+	int suspectTimeouts = SYNC_DEFAULT_SUSPECT_TIMEOUTS;
+	unsigned long cyclePeriod = 0;
+	int priority = 0, lockMemory = 0;
+	int cpus[SYNC_MAX_CPUS], cpuCount = 0;
+	char *cpu;
+	RobbusStats_Header_t *stats;
+	RobbusCommand_Queue_t *commands;
+	RobbusSnapshot_Header_t *snapshot;
+	SyncReload_t reload;
+	pthread_t reloadThread;
+	sigset_t signals;
+
+	while ((opt=getopt(argc, argv, "hzmd:b:c:i:t:v:p:r:a:s:f:")) != -1) {
+		switch (opt) {
+			case 'd':
+				deviceName = optarg;
+				break;
+			case 'b':
+				baudRate = strtoul(optarg, NULL, 10);
+				break;
+			case 'c':
+				configName = optarg;
+				break;
+			case 'i':
+				iterations = atoi(optarg);
+				break;
+			case 't':
+				turnaround = strtoul(optarg, NULL, 10);
+				break;
+			case 'z':
+				publishPerNode = 1;
+				break;
+			case 'v':
+				RobbusLog_SetLevel(atoi(optarg));
+				break;
+			case 'p':
+				cyclePeriod = strtoul(optarg, NULL, 10);
+				break;
+			case 'r':
+				priority = atoi(optarg);
+				break;
+			case 'a':
+				for (cpu = strtok(optarg, ","); cpu != NULL && cpuCount < SYNC_MAX_CPUS; cpu = strtok(NULL, ","))
+					cpus[cpuCount++] = atoi(cpu);
+				break;
+			case 'm':
+				lockMemory = 1;
+				break;
+			case 's':
+				spare = strtoul(optarg, NULL, 10);
+				break;
+			case 'f':
+				suspectTimeouts = atoi(optarg);
+				break;
+			default:
+				printUsage();
+				exit(1);
+		}
+	}
+	
+	printf("Syncing robbus device %s (config %s)\n", 
+		deviceName, configName);		
+
+	// read list of nodes
+	RobbusNodeList_Create(configName);
+	RobbusNodeList_PrintList();
+
+	// create shared memory, with room for nodes added later, segments
+	// of another size left by tools started before are replaced
+	reload.inDataSize = RobbusNodeList_GetTotalInDataSize() + spare;
+	reload.outDataSize = RobbusNodeList_GetTotalOutDataSize() + spare;
+	if (RobbusShm_CreateSegment(ROBBUS_SHM_INPUT_DATA, reload.inDataSize) == NULL
+		|| RobbusShm_CreateSegment(ROBBUS_SHM_OUTPUT_DATA, reload.outDataSize) == NULL
+		|| RobbusShm_CreateSegment(ROBBUS_SHM_GPS_DATA, 10) == NULL // TODO: enter correct GPS size
+		|| RobbusShm_CreateSegment(ROBBUS_SHM_CONTROL, sizeof(RobbusShm_Control_t)) == NULL) {
+		printf("Unable to create shared memory\n");
+		exit(1);
+	}
+
+	// split nodes by bus segments
+	buses = malloc((RobbusNodeList_GetNodeCount() + 1) * sizeof(SyncBus_t));
+	for (i = 0; i < RobbusNodeList_GetNodeCount(); i++) {
+		RobbusNodeList_Descriptor_t * node = RobbusNodeList_GetByIndex(i);
+		SyncBus_t *bus = getBus(buses, &busCount, node->bus[0] ? node->bus : deviceName);
+		bus->nodes[bus->nodeCount++] = node;
+		node->busIndex = bus - buses;
+	}
+	if (RobbusNodeList_PublishLayout() != 0)
+		printf("Layout has room for %d nodes only\n", ROBBUS_SHM_LAYOUT_MAX_NODES);
+
+	// reload never keeps more nodes than the layout takes, or than there are now
+	nodeCapacity = RobbusNodeList_GetNodeCount() > ROBBUS_SHM_LAYOUT_MAX_NODES ?
+		RobbusNodeList_GetNodeCount() : ROBBUS_SHM_LAYOUT_MAX_NODES;
+
+	// histograms for monitoring tools, syncing goes on without them
+	stats = RobbusStats_Create(busCount, nodeCapacity);
+	if (stats == NULL)
+		printf("Stats segment not created\n");
+	for (i = 0; stats != NULL && i < busCount; i++) {
+		buses[i].stats = RobbusStats_GetBus(stats, i);
+		strncpy(buses[i].stats->name, buses[i].deviceName, ROBBUS_STATS_NAME_SIZE - 1);
+	}
+
+	// priority commands, a ring for each bus
+	commands = RobbusCommand_Create(busCount);
+	if (commands == NULL)
+		printf("Command segment not created\n");
+	for (i = 0; commands != NULL && i < busCount; i++) {
+		buses[i].commandQueue = commands;
+		buses[i].commands = RobbusCommand_GetRing(commands, i);
+	}
+
+	// output of whole rounds, readers never hold the bus threads
+	snapshot = RobbusSnapshot_Create(busCount, reload.outDataSize);
+	if (snapshot == NULL)
+		printf("Snapshot segment not created\n");
+	for (i = 0; i < busCount; i++) {
+		buses[i].snapshot = snapshot;
+		buses[i].index = i;
+	}
+
+	for (i = 0; i < busCount; i++) {
+		buses[i].comm = RobbusComm_Open(buses[i].deviceName, baudRate);
+		if (buses[i].comm == NULL) {
+			printf("Unable to open %s\n", buses[i].deviceName);
+			exit(1);
+		}
+		RobbusComm_SetTurnaround(buses[i].comm, turnaround);
+		if (setupBusNodes(&buses[i], stats, i, NULL) != 0)
+			exit(1);
+		buses[i].iterations = iterations;
+		buses[i].publishPerNode = publishPerNode;
+		buses[i].suspectTimeouts = suspectTimeouts;
+		buses[i].inDataSize = reload.inDataSize;
+		buses[i].outDataSize = reload.outDataSize;
+		buses[i].nodeCapacity = nodeCapacity;
+		buses[i].cyclePeriodUs = cyclePeriod;
+		buses[i].priority = priority;
+		buses[i].cpu = cpuCount ? cpus[i % cpuCount] : -1;
+		buses[i].prefault = lockMemory;
+	}
+
+	// everything allocated so far and later stays in memory
+	if (lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+		perror("Locking memory failed");
+
+	// SIGHUP goes to the reloading thread only
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	// run one sync thread per bus, their logs are written by another one
+	if (RobbusLog_Start(stdout) != 0)
+		exit(1);
+	for (i = 0; i < busCount; i++) {
+		buses[i].running = 1;
+		if (pthread_create(&buses[i].thread, NULL, syncBus, &buses[i]) != 0) {
+			perror("Starting bus thread failed");
+			exit(1);
+		}
+	}
+	reload.buses = buses;
+	reload.busCount = busCount;
+	reload.configName = configName;
+	reload.deviceName = deviceName;
+	reload.stats = stats;
+	if (pthread_create(&reloadThread, NULL, reloadLoop, &reload) != 0)
+		perror("Starting reload thread failed"); // SIGHUP stays blocked
+	for (i = 0; i < busCount; i++) {
+		pthread_join(buses[i].thread, NULL);
+	}
+	RobbusLog_Stop();
 
 	// cleanup (will not be called ;)
-	RobbusComm_Close();
+	for (i = 0; i < busCount; i++) {
+		RobbusComm_Close(buses[i].comm);
+		freeBusNodes(&buses[i], NULL);
+	}
+	free(buses);
 	RobbusShm_Delete();
 	RobbusNodeList_Delete();
 	return 0;
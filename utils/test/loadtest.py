@@ -1,8 +1,12 @@
 #!/usr/bin/python
 
+import os
 import serial
 import time
 
+# bus speed, override by ROBBUS_BAUDRATE environment variable (e.g. 500000)
+BAUDRATE = int(os.environ.get('ROBBUS_BAUDRATE', 115200))
+
 def sendWrapped(ser,c, sum):
 	if ord(c) < 4:
 		ser.write("\x00")
@@ -91,7 +95,7 @@ def main(argv = None):
 		return
 	iters = int(argv[2])
 	print "Running", iters, "iterations"
-	ser = serial.Serial('/dev/robbus', 115200, timeout=1)
+	ser = serial.Serial('/dev/robbus', BAUDRATE, timeout=1)
 	address = argv[1]
 	for i in range(iters):
 		data = chr(i%256);
@@ -1,15 +1,19 @@
 #!/usr/bin/python
 
+import os
 import serial
 import time
 
+# bus speed, override by ROBBUS_BAUDRATE environment variable (e.g. 500000)
+BAUDRATE = int(os.environ.get('ROBBUS_BAUDRATE', 115200))
+
 def main(argv = None):
 	if len(argv) < 2:
 		print "Usage: loadtest.py iterations"
 		return
 	iters = int(argv[1])
 	print "Running", iters, "iterations"
-	ser = serial.Serial('/dev/robbus', 115200, timeout=1)
+	ser = serial.Serial('/dev/robbus', BAUDRATE, timeout=1)
 	requestStr = ""
 	requestStr += chr(2)
 	requestStr += chr(114)
@@ -1,10 +1,14 @@
 #!/usr/bin/python
 
+import os
 import serial
 import time
 
+# bus speed, override by ROBBUS_BAUDRATE environment variable (e.g. 500000)
+BAUDRATE = int(os.environ.get('ROBBUS_BAUDRATE', 115200))
+
 def main(argv = None):
-	ser = serial.Serial('/dev/ttyUSB1', 115200, timeout=30)
+	ser = serial.Serial('/dev/ttyUSB1', BAUDRATE, timeout=30)
 	data = ser.read(254)
 	i = 0
 	while i < len(data):
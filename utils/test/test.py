@@ -1,8 +1,12 @@
 #!/usr/bin/python
 
+import os
 import serial
 import time
 
+# bus speed, override by ROBBUS_BAUDRATE environment variable (e.g. 500000)
+BAUDRATE = int(os.environ.get('ROBBUS_BAUDRATE', 115200))
+
 def sendWrapped(ser,c, sum):
 	if ord(c) < 4:
 		ser.write("\x00")
@@ -97,7 +101,7 @@ def main(argv = None):
 		print "Example (bash): ./test.py KRT1 \\\\x0305"
 		return
 	
-	ser = serial.Serial('/dev/robbus', 115200, timeout=1)
+	ser = serial.Serial('/dev/robbus', BAUDRATE, timeout=1)
 	if argv[1][0:2] == "\\x":
 		print "Decoding hex address"
 		address = argv[1][2:].decode("hex");